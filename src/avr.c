@@ -264,6 +264,17 @@ int avr_read_byte_default(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM
 }
 
 
+static int disableffopt;
+
+/*
+ * Can 0xff runs of this memory be left out of reads and output files? Only
+ * for flash-type memories unless disable_trailing_ff_removal() was called
+ */
+int avr_mem_ffopt(const AVRMEM *mem) {
+  return !disableffopt && avr_mem_is_flash_type(mem);
+}
+
+
 /*
  * Return the number of "interesting" bytes in a memory buffer,
  * "interesting" being defined as up to the last non-0xff data
@@ -275,7 +286,6 @@ int avr_read_byte_default(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM
 int avr_mem_hiaddr(const AVRMEM * mem)
 {
   int i, n;
-  static int disableffopt;
 
   /* calling once with NULL disables any future trailing-0xff optimisation */
   if(!mem) {
@@ -283,11 +293,8 @@ int avr_mem_hiaddr(const AVRMEM * mem)
     return 0;
   }
 
-  if(disableffopt)
-    return mem->size;
-
   /* if the memory is not a flash-type memory do not remove trailing 0xff */
-  if(!avr_mem_is_flash_type(mem))
+  if(!avr_mem_ffopt(mem))
     return mem->size;
 
   /* return the highest non-0xff address regardless of how much
@@ -425,8 +432,10 @@ int avr_read_mem(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem, con
           break;
         }
       if (need_read) {
+        unsigned long start = avr_ustimestamp();
         rc = pgm->paged_load(pgm, p, mem, mem->page_size,
                             pageaddr, mem->page_size);
+        trace_page(0, avr_ustimestamp() - start);
         if (rc < 0)
           /* paged load failed, fall back to byte-at-a-time read below */
           failure = 1;
@@ -984,7 +993,7 @@ int avr_write_mem(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m, int
              continue;
 
           // Read flash contents to separate memory spc and fill in holes
-          if(avr_read_page_default(pgm, p, cm, beg, spc) >= 0) {
+          if(avr_read_page_cached(pgm, p, cm, beg, spc) >= 0) {
             pmsg_notice2("padding %s [0x%04x, 0x%04x]\n", cm->desc, beg, end-1);
             for(i = beg; i < end; i++)
               if(!(cm->tags[i] & TAG_ALLOCATED)) {
@@ -1023,8 +1032,11 @@ int avr_write_mem(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m, int
         rc = 0;
         if (auto_erase)
           rc = pgm->page_erase(pgm, p, cm, pageaddr);
-        if (rc >= 0)
+        if (rc >= 0) {
+          unsigned long start = avr_ustimestamp();
           rc = pgm->paged_write(pgm, p, cm, cm->page_size, pageaddr, cm->page_size);
+          trace_page(1, avr_ustimestamp() - start);
+        }
         if (rc < 0)
           /* paged write failed, fall back to byte-at-a-time write below */
           failure = 1;
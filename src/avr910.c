@@ -50,6 +50,7 @@ struct pdata
   unsigned int buffersize;
   unsigned char test_blockmode;
   unsigned char use_blockmode;
+  unsigned char no_blockwrite;  // Set once a block write was not acknowledged
 };
 
 #define PDATA(pgm) ((struct pdata *)(pgm->cookie))
@@ -93,7 +94,7 @@ static int avr910_drain(const PROGRAMMER *pgm, int display) {
 
 
 static int avr910_vfy_cmd_sent(const PROGRAMMER *pgm, char *errmsg) {
-  char c;
+  char c = 0;
 
   avr910_recv(pgm, &c, 1);
   if (c != '\r') {
@@ -561,63 +562,75 @@ static int avr910_paged_write_eeprom(const PROGRAMMER *pgm, const AVRPART *p,
 }
 
 
-static int avr910_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
-                              unsigned int page_size,
-                              unsigned int addr, unsigned int n_bytes)
+/*
+ * Block mode write of flash or EEPROM: stream the data in chunks of up to
+ * buffersize bytes, as reported by the 'b' query, with a single '\r'
+ * acknowledgement per chunk rather than one per byte. The programmer
+ * buffers a chunk before programming it (and, for flash, writes the page
+ * at its end), so EEPROM can be written in chunks as well. Returns the
+ * end address or -1 if a chunk was not acknowledged.
+ */
+static int avr910_paged_write_block(const PROGRAMMER *pgm, const AVRMEM *m,
+                                    unsigned int addr, unsigned int n_bytes)
 {
-  int rval = 0;
-  if (PDATA(pgm)->use_blockmode == 0) {
-    if (strcmp(m->desc, "flash") == 0) {
-      rval = avr910_paged_write_flash(pgm, p, m, page_size, addr, n_bytes);
-    } else if (strcmp(m->desc, "eeprom") == 0) {
-      rval = avr910_paged_write_eeprom(pgm, p, m, page_size, addr, n_bytes);
-    } else {
-      rval = -2;
-    }
-  }
+  unsigned int max_addr = addr + n_bytes;
+  unsigned int blocksize = PDATA(pgm)->buffersize;
+  int wr_size = m->desc[0] == 'e'? 1: 2;
+  char *cmd;
 
-  if (PDATA(pgm)->use_blockmode == 1) {
-    unsigned int max_addr = addr + n_bytes;
-    char *cmd;
-    unsigned int blocksize = PDATA(pgm)->buffersize;
-    int wr_size;
+  if (wr_size == 2)
+    blocksize &= ~1U;           /* Flash is written in whole words */
 
-    if (strcmp(m->desc, "flash") && strcmp(m->desc, "eeprom"))
-      return -2;
+  avr910_set_addr(pgm, addr / wr_size);
 
-    if (m->desc[0] == 'e') {
-      blocksize = 1;		/* Write to eeprom single bytes only */
-      wr_size = 1;
-    } else {
-      wr_size = 2;
+  cmd = cfg_malloc("avr910_paged_write_block()", 4 + blocksize);
+  cmd[0] = 'B';
+  cmd[3] = toupper((int)(m->desc[0]));
+
+  while (addr < max_addr) {
+    if ((max_addr - addr) < blocksize)
+      blocksize = max_addr - addr;
+    memcpy(&cmd[4], &m->buf[addr], blocksize);
+    cmd[1] = (blocksize >> 8) & 0xff;
+    cmd[2] = blocksize & 0xff;
+
+    avr910_send(pgm, cmd, 4 + blocksize);
+    if (avr910_vfy_cmd_sent(pgm, "write block")) {
+      free(cmd);
+      return -1;
     }
 
-    avr910_set_addr(pgm, addr / wr_size);
+    addr += blocksize;
+  }
+  free(cmd);
 
-    cmd = malloc(4 + blocksize);
-    if (!cmd) return -1;
-     
-    cmd[0] = 'B';
-    cmd[3] = toupper((int)(m->desc[0]));
+  return addr;
+}
 
-    while (addr < max_addr) {
-      if ((max_addr - addr) < blocksize) {
-        blocksize = max_addr - addr;
-      };
-      memcpy(&cmd[4], &m->buf[addr], blocksize);
-      cmd[1] = (blocksize >> 8) & 0xff;
-      cmd[2] = blocksize & 0xff;
 
-      avr910_send(pgm, cmd, 4 + blocksize);
-      avr910_vfy_cmd_sent(pgm, "write block");
+static int avr910_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
+                              unsigned int page_size,
+                              unsigned int addr, unsigned int n_bytes)
+{
+  if (strcmp(m->desc, "flash") && strcmp(m->desc, "eeprom"))
+    return -2;
 
-      addr += blocksize;
-    } /* while */
-    free(cmd);
+  if (PDATA(pgm)->use_blockmode && !PDATA(pgm)->no_blockwrite &&
+      PDATA(pgm)->buffersize >= (m->desc[0] == 'e'? 1U: 2U)) {
+    int rval = avr910_paged_write_block(pgm, m, addr, n_bytes);
+    if (rval >= 0)
+      return rval;
 
-    rval = addr;
+    /* Rewrite the whole range byte by byte from now on */
+    pmsg_warning("programmer did not accept block write, falling back to byte-wise writes\n");
+    PDATA(pgm)->no_blockwrite = 1;
+    avr910_drain(pgm, 0);
   }
-  return rval;
+
+  if (strcmp(m->desc, "flash") == 0)
+    return avr910_paged_write_flash(pgm, p, m, page_size, addr, n_bytes);
+
+  return avr910_paged_write_eeprom(pgm, p, m, page_size, addr, n_bytes);
 }
 
 
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/time.h>
@@ -30,6 +31,7 @@
 #include "avrdude.h"
 #include "libavrdude.h"
 #include "avrintel.h"
+#include "crc16.h"
 
 /*
  * Provides an API for cached bytewise access
@@ -67,7 +69,11 @@
  * and flash caches are fully read in, a pgm->chip_erase() command is issued
  * and both EEPROM and flash are written back to the device. Hence, it can
  * take minutes to ensure that a single previously cleared bit is set and,
- * therefore, this routine should be called sparingly.
+ * therefore, this routine should be called sparingly. Page erase is only
+ * applied to those pages that need a cleared bit set. When page erase works
+ * but would need to be applied to many pages, the costs of both strategies
+ * are estimated from timings taken while probing the memory, and chip erase
+ * is chosen only if even its worst case is cheaper than the page-erase plan.
  *
  * avr_chip_erase_cached() erases the chip and discards pending writes() to
  * flash or EEPROM. It presets the flash cache to all 0xff alleviating the
@@ -91,6 +97,50 @@
  * Finally, avr_reset_cache() resets the cache without synchronising pending
  * writes() to the device.
  *
+ * The cache can also serve -U operations and outlive the process:
+ *
+ * int avr_read_page_cached(const PROGRAMMER *pgm, const AVRPART *p, const
+ *   AVRMEM *mem, int addr, unsigned char *buf);
+ *
+ * int avr_peek_page_cached(const PROGRAMMER *pgm, const AVRPART *p, const
+ *   AVRMEM *mem, int addr, unsigned char *buf);
+ *
+ * int avr_read_mem_cached(const PROGRAMMER *pgm, const AVRPART *p, const
+ *   AVRMEM *mem, const AVRPART *v);
+ *
+ * int avr_cache_forget(const PROGRAMMER *pgm, const AVRPART *p, const
+ *   AVRMEM *mem);
+ *
+ * int avr_cache_load(const PROGRAMMER *pgm, const AVRPART *p, const char
+ *   *fname, const char *key);
+ *
+ * int avr_cache_save(const PROGRAMMER *pgm, const AVRPART *p, const char
+ *   *fname, const char *key);
+ *
+ * avr_read_page_cached() copies the device contents of the page containing
+ * addr into buf, reading the page from the device only if it is not cached;
+ * avr_peek_page_cached() differs only in how it treats pages from a cache
+ * file (see below).
+ * avr_read_mem_cached() does the same for a whole memory with the semantics
+ * of avr_read_mem(), so that repeated reads and verifies of the same memory
+ * during one run are served from the cache. Writes bypass the cache, and
+ * avr_cache_forget() is used afterwards to drop the pages of mem with
+ * allocated bytes from the cache, as their device contents are not known
+ * until read back.
+ *
+ * avr_cache_save() writes all cached flash and EEPROM pages to a file that
+ * is protected by a CRC and identified by a key, which the caller composes
+ * from programmer, port, part signature and serial number. In a later run,
+ * avr_cache_load() seeds the caches from that file provided the key and the
+ * memory geometry match, and provided a spot check of the first cached
+ * flash and EEPROM page against the device succeeds; otherwise the file is
+ * ignored. Loaded pages are marked as coming from the file: only
+ * avr_peek_page_cached(), which serves the comparisons of differential
+ * writes, takes them on trust; avr_read_page_cached(), used for padding
+ * partly written pages, and avr_read_mem_cached(), which serves -U reads
+ * and verifies, read them from the device. Should one of them differ from
+ * the device, all pages loaded from the file are dropped.
+ *
  * This file also holds the following utility functions
  *
  * // Does the programmer/memory combo have paged memory access?
@@ -150,7 +200,10 @@ int avr_read_page_default(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM
     return fallback_read_byte(pgm, p, mem, addr, buf);
 
   memcpy(pagecopy, mem->buf + base, pgsize);
-  if((rc = pgm->paged_load(pgm, p, mem, pgsize, base, pgsize)) >= 0)
+  unsigned long start = avr_ustimestamp();
+  rc = pgm->paged_load(pgm, p, mem, pgsize, base, pgsize);
+  trace_page(0, avr_ustimestamp() - start);
+  if(rc >= 0)
     memcpy(buf, mem->buf + base, pgsize);
   memcpy(mem->buf + base, pagecopy, pgsize);
 
@@ -189,7 +242,9 @@ int avr_write_page_default(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM
 
   memcpy(pagecopy, mem->buf + base, pgsize);
   memcpy(mem->buf + base, data, pgsize);
+  unsigned long start = avr_ustimestamp();
   rc = pgm->paged_write(pgm, p, mem, pgsize, base, pgsize);
+  trace_page(1, avr_ustimestamp() - start);
   memcpy(mem->buf + base, pagecopy, pgsize);
   free(pagecopy);
 
@@ -346,19 +401,53 @@ typedef struct {
   AVRMEM *mem;
   AVR_Cache *cp;
   int isflash, zopaddr, pgerase;
+  int nzop;                     // Number of changed pages that need a cleared bit set
 } CacheDesc_t;
 
 
+// Time estimates in us for a page read, page write and page erase (0 if not known)
+typedef struct {
+  unsigned long rd, wr, pe;
+} CacheTiming_t;
+
+
+// Worst-case us for chip erase, reading all uncached pages and writing back all non-0xff pages
+static unsigned long chipEraseCost(const PROGRAMMER *pgm, const AVRPART *p, const CacheDesc_t *mems,
+  size_t nmems, const CacheTiming_t *t) {
+
+  unsigned long cost = p->chip_erase_delay > 0? p->chip_erase_delay: 0;
+
+  for(size_t i = 0; i < nmems; i++) {
+    AVR_Cache *cp = mems[i].cp;
+    if(!mems[i].mem || !cp->cont)
+      continue;
+
+    for(int pgno = 0, n = 0; n < cp->size; pgno++, n += cp->page_size) {
+      if(!cp->iscached[pgno])
+        cost += t->rd + t->wr;
+      else if(!_is_all_0xff(cp->cont + n, cp->page_size))
+        cost += t->wr;
+    }
+    if(mems[i].isflash && (pgm->prog_modes & PM_SPM)) // Read back bootloader section
+      cost += (cp->size - guessBootStart(pgm, p))/cp->page_size * t->rd;
+  }
+
+  return cost;
+}
+
+
 // Write both EEPROM and flash caches to device and free them
 int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p) {
   CacheDesc_t mems[2] = {
-    { avr_locate_mem(p, "flash"), pgm->cp_flash, 1, -1, 0 },
-    { avr_locate_mem(p, "eeprom"), pgm->cp_eeprom, 0, -1, 0 },
+    { avr_locate_mem(p, "flash"), pgm->cp_flash, 1, -1, 0, 0 },
+    { avr_locate_mem(p, "eeprom"), pgm->cp_eeprom, 0, -1, 0, 0 },
   };
+  CacheTiming_t tim = { 0, 0, 0 };
+  unsigned long tstart = avr_ustimestamp(), estimate = 0, t0;
 
   int chpages = 0;
   bool chiperase = 0;
-  // Count page changes and find a page that needs a clear bit set
+  // Count page changes and find pages that need a clear bit set
   for(size_t i = 0; i < sizeof mems/sizeof*mems; i++) {
     AVRMEM *mem = mems[i].mem;
     AVR_Cache *cp = mems[i].cp;
@@ -369,8 +458,11 @@ int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p) {
       if(cp->iscached[pgno])
         if(memcmp(cp->copy + n, cp->cont + n, cp->page_size)) {
           chpages++;
-          if(mems[i].zopaddr == -1 && !avr_is_and(cp->cont + n, cp->copy + n, cp->cont + n, cp->page_size))
-            mems[i].zopaddr = n;
+          if(!avr_is_and(cp->cont + n, cp->copy + n, cp->cont + n, cp->page_size)) {
+            mems[i].nzop++;
+            if(mems[i].zopaddr == -1)
+              mems[i].zopaddr = n;
+          }
         }
     }
   }
@@ -402,21 +494,38 @@ int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p) {
 
     int n=mems[i].zopaddr;
 
+    t0 = avr_ustimestamp();
     if(writeCachePage(cp, pgm, p, mem, n, 1) < 0)
       return LIBAVRDUDE_GENERAL_FAILURE;
+    unsigned long twrrd = avr_ustimestamp() - t0;
     // Same? OK, can set cleared bit to one, "normal" memory
     if(!memcmp(cp->copy + n, cp->cont + n, cp->page_size)) {
       chpages--;
+      mems[i].nzop = 0;
       continue;
     }
 
+    // Separate read from write time for cost estimates (one extra page read)
+    t0 = avr_ustimestamp();
+    if(avr_read_page_default(pgm, p, mem, n, cp->copy + n) >= 0) {
+      unsigned long trd = avr_ustimestamp() - t0;
+      if(trd > tim.rd)
+        tim.rd = trd;
+      if(twrrd > tim.rd && twrrd - tim.rd > tim.wr)
+        tim.wr = twrrd - tim.rd;
+    }
+
     // Probably NOR memory, check out page erase
+    t0 = avr_ustimestamp();
     if(silent_page_erase(pgm, p, mem, n) >= 0) {
+      if(avr_ustimestamp() - t0 > tim.pe)
+        tim.pe = avr_ustimestamp() - t0;
       if(writeCachePage(cp, pgm, p, mem, n, 1) < 0)
         return LIBAVRDUDE_GENERAL_FAILURE;
       // Worked OK? Can use page erase on this memory
       if(!memcmp(cp->copy + n, cp->cont + n, cp->page_size)) {
         mems[i].pgerase = 1;
+        mems[i].nzop--;
         chpages--;
         continue;
       }
@@ -430,7 +539,24 @@ int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p) {
     return LIBAVRDUDE_SUCCESS;
   }
 
+  // Estimated cost of writing remaining pages, page erasing only those that need a set bit
+  for(size_t i = 0; i < sizeof mems/sizeof*mems; i++)
+    if(mems[i].mem && mems[i].cp->cont)
+      estimate += mems[i].nzop*tim.pe;
+  estimate += chpages*tim.wr;
+
+  // Chip erase instead of many page erases? Only if its worst case is cheaper (not for bootloaders)
+  if(!chiperase && !(pgm->prog_modes & PM_SPM) && tim.pe && p->chip_erase_delay > 0) {
+    unsigned long cecost = chipEraseCost(pgm, p, mems, sizeof mems/sizeof*mems, &tim);
+    if(cecost < estimate) {
+      pmsg_notice2("chip erase estimated at %.3f s cheaper than page erase at %.3f s\n",
+        cecost/1e6, estimate/1e6);
+      chiperase = 1;
+    }
+  }
+
   if(chiperase) {
+    estimate = chipEraseCost(pgm, p, mems, sizeof mems/sizeof*mems, &tim);
     if(quell_progress) {
       msg_info("reading/chip erase/writing cycle needed ... ");
       fflush(stderr);
@@ -549,7 +675,8 @@ int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p) {
 
       for(int iwr = 0, pgno = 0, n = 0; n < cp->size; pgno++, n += cp->page_size) {
         if(cp->iscached[pgno] && memcmp(cp->copy + n, cp->cont + n, cp->page_size)) {
-          if(!chiperase && mems[i].pgerase)
+          if(!chiperase && mems[i].pgerase && // Only erase if a cleared bit needs to be set
+            !avr_is_and(cp->cont + n, cp->copy + n, cp->cont + n, cp->page_size))
             pgm->page_erase(pgm, p, mem, n);
           if(writeCachePage(cp, pgm, p, mem, n, 1) < 0)
             return LIBAVRDUDE_GENERAL_FAILURE;
@@ -568,6 +695,10 @@ int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p) {
   report_progress(1, 0, NULL);
 
   msg_info(quell_progress? "done\n": "\n");
+  if(tim.wr)
+    pmsg_notice("cache synchronisation took %.3f s (estimated %.3f s)\n",
+      (avr_ustimestamp() - tstart)/1e6, estimate/1e6);
+
   return LIBAVRDUDE_SUCCESS;
 }
 
@@ -659,8 +790,8 @@ int avr_write_byte_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM
 // Erase the chip and set the cache accordingly
 int avr_chip_erase_cached(const PROGRAMMER *pgm, const AVRPART *p) {
   CacheDesc_t mems[2] = {
-    { avr_locate_mem(p, "flash"), pgm->cp_flash, 1, -1, 0 },
-    { avr_locate_mem(p, "eeprom"), pgm->cp_eeprom, 0, -1, 0 },
+    { avr_locate_mem(p, "flash"), pgm->cp_flash, 1, -1, 0, 0 },
+    { avr_locate_mem(p, "eeprom"), pgm->cp_eeprom, 0, -1, 0, 0 },
   };
   int rc;
 
@@ -772,3 +903,341 @@ int avr_reset_cache(const PROGRAMMER *pgm, const AVRPART *p_unused) {
 
   return LIBAVRDUDE_SUCCESS;
 }
+
+
+static AVR_Cache *memCache(const PROGRAMMER *pgm, const AVRMEM *mem) {
+  return avr_mem_is_eeprom_type(mem)? pgm->cp_eeprom: pgm->cp_flash;
+}
+
+
+/*
+ * Read a page that was loaded from the cache file from the device; if it differs, the file
+ * was stale, so drop all pages loaded from it and keep the device contents of this page
+ */
+static int confirmCachePage(AVR_Cache *cp, const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem,
+  int addr, int cacheaddr, unsigned char *spc) {
+
+  int pgsize = cp->page_size;
+
+  if(avr_read_page_default(pgm, p, mem, addr, spc) < 0) {
+    pmsg_error("unable to read %s page at addr 0x%04x\n", mem->desc, addr);
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+  if(memcmp(spc, cp->copy + cacheaddr, pgsize)) {
+    pmsg_warning("device %s differs from cache file at 0x%04x, not using cache file contents\n",
+      mem->desc, addr);
+    AVR_Cache *caches[2] = { pgm->cp_flash, pgm->cp_eeprom };
+    for(size_t i = 0; i < sizeof caches/sizeof*caches; i++) {
+      AVR_Cache *c = caches[i];
+      for(int n = 0; c->cont && n < c->size; n += c->page_size) // Keep pending writes
+        if(c->iscached[n/c->page_size] == 2 && !memcmp(c->cont + n, c->copy + n, c->page_size))
+          c->iscached[n/c->page_size] = 0;
+    }
+    if(!memcmp(cp->cont + cacheaddr, cp->copy + cacheaddr, pgsize))
+      memcpy(cp->cont + cacheaddr, spc, pgsize);
+    memcpy(cp->copy + cacheaddr, spc, pgsize);
+  }
+  cp->iscached[cacheaddr/pgsize] = 1;
+
+  return LIBAVRDUDE_SUCCESS;
+}
+
+
+// Copy the cached page containing addr into buf; confirm pages from a cache file if asked to
+static int readPageCached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem,
+  int addr, unsigned char *buf, int confirm) {
+
+  if(!avr_has_paged_access(pgm, mem) || addr < 0 || addr >= mem->size)
+    return LIBAVRDUDE_GENERAL_FAILURE;
+
+  AVR_Cache *cp = memCache(pgm, mem);
+
+  if(!cp->cont)                 // Init cache if needed
+    if(initCache(cp, pgm, p) < 0)
+      return LIBAVRDUDE_GENERAL_FAILURE;
+
+  int cacheaddr = cacheAddress(addr, cp, mem);
+  if(cacheaddr < 0)
+    return LIBAVRDUDE_GENERAL_FAILURE;
+
+  int base = cacheaddr & ~(cp->page_size-1);
+  if(confirm && cp->iscached[base/cp->page_size] == 2) {
+    unsigned char *spc = cfg_malloc(__func__, cp->page_size);
+    int rc = confirmCachePage(cp, pgm, p, mem, addr & ~(cp->page_size-1), base, spc);
+    free(spc);
+    if(rc < 0)
+      return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+
+  if(loadCachePage(cp, pgm, p, mem, addr, cacheaddr, 0) < 0)
+    return LIBAVRDUDE_GENERAL_FAILURE;
+
+  memcpy(buf, cp->copy + base, cp->page_size);
+
+  return LIBAVRDUDE_SUCCESS;
+}
+
+// Copy the device contents of the page containing addr into buf using the cache
+int avr_read_page_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem,
+  int addr, unsigned char *buf) {
+
+  return readPageCached(pgm, p, mem, addr, buf, 1);
+}
+
+// Same, but pages loaded from a cache file are taken on trust (for differential writes)
+int avr_peek_page_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem,
+  int addr, unsigned char *buf) {
+
+  return readPageCached(pgm, p, mem, addr, buf, 0);
+}
+
+
+/*
+ * Read memory through the cache, otherwise like avr_read_mem(): if v is given, only read
+ * pages that have allocated bytes in mem; falls back to avr_read_mem() without paged access
+ * or for TPI parts, which avr_read_mem() reads via pgm->cmd_tpi()
+ */
+int avr_read_mem_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem, const AVRPART *v) {
+  if(!avr_has_paged_access(pgm, mem) || ((p->prog_modes & PM_TPI) && pgm->cmd_tpi))
+    return avr_read_mem(pgm, p, mem, v);
+
+  AVR_Cache *cp = memCache(pgm, mem);
+
+  if(!cp->cont)
+    if(initCache(cp, pgm, p) < 0)
+      return LIBAVRDUDE_GENERAL_FAILURE;
+
+  int pgsize = mem->page_size, npages = 0, nread = 0;
+  unsigned char *needed = cfg_malloc(__func__, mem->size/pgsize), *spc = cfg_malloc(__func__, pgsize);
+
+  for(int base = 0; base < mem->size; base += pgsize)
+    for(int i = base; i < base + pgsize; i++)
+      if(!v || (mem->tags[i] & TAG_ALLOCATED)) {
+        needed[base/pgsize] = 1;
+        npages++;
+        break;
+      }
+
+  memset(mem->buf, 0xff, mem->size);
+  for(int base = 0; base < mem->size; base += pgsize) {
+    if(!needed[base/pgsize])
+      continue;
+
+    int cacheaddr = cacheAddress(base, cp, mem);
+    if(cacheaddr >= 0 && cp->iscached[cacheaddr/pgsize] == 2 && confirmCachePage(cp, pgm, p, mem,
+      base, cacheaddr, spc) < 0)
+      cacheaddr = -1;
+    if(cacheaddr < 0 || loadCachePage(cp, pgm, p, mem, base, cacheaddr, 0) < 0) {
+      free(needed);
+      free(spc);
+      return LIBAVRDUDE_GENERAL_FAILURE;
+    }
+    memcpy(mem->buf + base, cp->copy + cacheaddr, pgsize);
+    report_progress(nread++, npages, NULL);
+  }
+  free(needed);
+  free(spc);
+
+  return avr_mem_hiaddr(mem);
+}
+
+
+// Drop pages with allocated bytes of mem from the cache
+int avr_cache_forget(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem) {
+  AVR_Cache *cp = memCache(pgm, mem);
+
+  if(!avr_has_paged_access(pgm, mem) || !cp->cont)
+    return LIBAVRDUDE_SUCCESS;
+
+  for(int base = 0; base < mem->size; base += mem->page_size) {
+    int cacheaddr = cacheAddress(base, cp, mem);
+    if(cacheaddr < 0)
+      return LIBAVRDUDE_GENERAL_FAILURE;
+
+    for(int i = base; i < base + mem->page_size; i++)
+      if(mem->tags[i] & TAG_ALLOCATED) {
+        cp->iscached[cacheaddr/cp->page_size] = 0;
+        break;
+      }
+  }
+
+  return LIBAVRDUDE_SUCCESS;
+}
+
+
+#define CACHE_MAGIC "avrdude cache 1\n"
+
+// Save cached flash and EEPROM pages to file fname identified by key
+int avr_cache_save(const PROGRAMMER *pgm, const AVRPART *p, const char *fname, const char *key) {
+  CacheDesc_t mems[2] = {
+    { avr_locate_mem(p, "flash"), pgm->cp_flash, 1, -1, 0, 0 },
+    { avr_locate_mem(p, "eeprom"), pgm->cp_eeprom, 0, -1, 0, 0 },
+  };
+
+  size_t len = strlen(CACHE_MAGIC) + strlen(key) + 1 + 2;
+  for(size_t i = 0; i < sizeof mems/sizeof*mems; i++) {
+    AVR_Cache *cp = mems[i].cp;
+    len += 64;
+    if(mems[i].mem && cp->cont)
+      for(int pgno = 0; pgno < cp->size/cp->page_size; pgno++)
+        if(cp->iscached[pgno])
+          len += 4 + cp->page_size;
+  }
+
+  unsigned char *buf = cfg_malloc(__func__, len), *q = buf;
+
+  q += sprintf((char *) q, "%s%s\n", CACHE_MAGIC, key);
+  for(size_t i = 0; i < sizeof mems/sizeof*mems; i++) {
+    AVR_Cache *cp = mems[i].cp;
+    int npages = 0;
+
+    if(mems[i].mem && cp->cont)
+      for(int pgno = 0; pgno < cp->size/cp->page_size; pgno++)
+        npages += !!cp->iscached[pgno];
+
+    q += sprintf((char *) q, "%s %d %d %d\n", mems[i].isflash? "flash": "eeprom",
+      npages? cp->size: 0, npages? cp->page_size: 0, npages);
+    for(int pgno = 0; npages && pgno < cp->size/cp->page_size; pgno++) {
+      if(cp->iscached[pgno]) {
+        int n = pgno*cp->page_size;
+        for(int k = 0; k < 4; k++)
+          *q++ = n >> 8*k;
+        memcpy(q, cp->copy + n, cp->page_size);
+        q += cp->page_size;
+      }
+    }
+  }
+  crcappend(buf, q-buf);
+  q += 2;
+
+  FILE *f = fopen(fname, "wb");
+  if(!f || fwrite(buf, 1, q-buf, f) != (size_t) (q-buf) || fclose(f)) {
+    pmsg_ext_error("cannot write cache file %s: %s\n", fname, strerror(errno));
+    free(buf);
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+  free(buf);
+
+  return LIBAVRDUDE_SUCCESS;
+}
+
+
+// Parse "<name> <size> <page_size> <npages>\n" at *qp
+static int cacheMemHeader(unsigned char **qp, const unsigned char *end, const char *name,
+  int *sizep, int *pgsizep, int *npagesp) {
+
+  char fmt[32];
+  int nc = 0;
+
+  if(!memchr(*qp, '\n', end - *qp))
+    return -1;
+  sprintf(fmt, "%s %%d %%d %%d%%n", name);
+  if(sscanf((char *) *qp, fmt, sizep, pgsizep, npagesp, &nc) != 3 || (*qp)[nc] != '\n')
+    return -1;
+  *qp += nc+1;
+
+  return 0;
+}
+
+
+/*
+ * Seed flash and EEPROM caches from file fname if it was saved with the same key for the
+ * same memory geometry and if it passes a spot check against the device. Returns the number
+ * of pages loaded, or a negative value if the file could not be used.
+ */
+int avr_cache_load(const PROGRAMMER *pgm, const AVRPART *p, const char *fname, const char *key) {
+  CacheDesc_t mems[2] = {
+    { avr_locate_mem(p, "flash"), pgm->cp_flash, 1, -1, 0, 0 },
+    { avr_locate_mem(p, "eeprom"), pgm->cp_eeprom, 0, -1, 0, 0 },
+  };
+  unsigned char *buf = NULL, *q, *end;
+  long len;
+  int ret = 0;
+  FILE *f;
+
+  if(!(f = fopen(fname, "rb"))) {
+    pmsg_notice("no cache file %s yet\n", fname);
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+  if(fseek(f, 0, SEEK_END) || (len = ftell(f)) < 2 || fseek(f, 0, SEEK_SET)) {
+    fclose(f);
+    goto corrupt;
+  }
+  buf = cfg_malloc(__func__, len+1);
+  if(fread(buf, 1, len, f) != (size_t) len || !crcverify(buf, len)) {
+    fclose(f);
+    goto corrupt;
+  }
+  fclose(f);
+  end = buf + len-2;
+
+  size_t mlen = strlen(CACHE_MAGIC), klen = strlen(key);
+  if(end-buf < (long) (mlen+klen+1) || memcmp(buf, CACHE_MAGIC, mlen))
+    goto corrupt;
+  if(memcmp(buf+mlen, key, klen) || buf[mlen+klen] != '\n') {
+    pmsg_notice("cache file %s is for a different device or port, ignoring it\n", fname);
+    free(buf);
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+  q = buf+mlen+klen+1;
+
+  for(size_t i = 0; i < sizeof mems/sizeof*mems; i++) {
+    AVRMEM *mem = mems[i].mem;
+    AVR_Cache *cp = mems[i].cp;
+    int size, pgsize, npages;
+
+    if(cacheMemHeader(&q, end, mems[i].isflash? "flash": "eeprom", &size, &pgsize, &npages) < 0)
+      goto corrupt;
+    if(!npages)
+      continue;
+    if(!mem || !avr_has_paged_access(pgm, mem) || mem->size != size || mem->page_size != pgsize ||
+      npages < 0 || npages > size/pgsize || end-q < (long) npages*(4+pgsize)) {
+      pmsg_notice("cache file %s does not match %s memory geometry, ignoring it\n", fname,
+        mem? mem->desc: mems[i].isflash? "flash": "eeprom");
+      ret = LIBAVRDUDE_GENERAL_FAILURE;
+      break;
+    }
+
+    if(!cp->cont)
+      if(initCache(cp, pgm, p) < 0) {
+        ret = LIBAVRDUDE_GENERAL_FAILURE;
+        break;
+      }
+
+    for(int k = 0; k < npages; k++, q += 4+pgsize) {
+      int n = q[0] | q[1]<<8 | q[2]<<16 | q[3]<<24;
+      if(n < 0 || n >= size || n % pgsize)
+        goto corrupt;
+      memcpy(cp->copy + n, q+4, pgsize);
+      memcpy(cp->cont + n, q+4, pgsize);
+      cp->iscached[n/pgsize] = 2;
+    }
+
+    // Spot check the first cached page against the device
+    unsigned char *spc = cfg_malloc(__func__, pgsize);
+    for(int n = 0; n < size; n += pgsize)
+      if(cp->iscached[n/pgsize]) {
+        if(avr_read_page_default(pgm, p, mem, n, spc) < 0 || memcmp(spc, cp->copy + n, pgsize)) {
+          pmsg_notice("device %s differs from cache file %s, ignoring it\n", mem->desc, fname);
+          ret = LIBAVRDUDE_GENERAL_FAILURE;
+        }
+        break;
+      }
+    free(spc);
+    if(ret < 0)
+      break;
+    ret += npages;
+  }
+
+  free(buf);
+  if(ret < 0)
+    avr_reset_cache(pgm, p);
+
+  return ret;
+
+corrupt:
+  pmsg_warning("cache file %s is corrupt, ignoring it\n", fname);
+  free(buf);
+  avr_reset_cache(pgm, p);
+  return LIBAVRDUDE_GENERAL_FAILURE;
+}
@@ -203,7 +203,8 @@ static int set_frequency(avrftdi_t* ftdi, uint32_t freq)
 		divisor = 65535;
 	}
 
-	log_info("Using frequency: %d\n", 6000000/(divisor+1));
+	ftdi->sck_freq = 6000000/(divisor+1);
+	log_info("Using frequency: %d\n", ftdi->sck_freq);
 	log_info("Clock divisor: 0x%04x\n", divisor);
 
 	buf[0] = TCK_DIVISOR;
@@ -426,11 +427,13 @@ static int avrftdi_transmit_mpsse(avrftdi_t* pdata, unsigned char mode, const un
 
 	E(ftdi_write_data(pdata->ftdic, cmd, sizeof(cmd)) != sizeof(cmd), pdata->ftdic);
 
+	size_t ahead = 0;	/* size of the block already sent ahead */
 	while(remaining)
 	{
 		size_t transfer_size = (remaining > blocksize) ? blocksize : remaining;
 
-		E((size_t) ftdi_write_data(pdata->ftdic, (unsigned char*)&buf[written], transfer_size) != transfer_size, pdata->ftdic);
+		if(!ahead)
+			E((size_t) ftdi_write_data(pdata->ftdic, (unsigned char*)&buf[written], transfer_size) != transfer_size, pdata->ftdic);
 #if 0
 		if(remaining < blocksize)
 			E(ftdi_write_data(pdata->ftdic, &si, sizeof(si)) != sizeof(si), pdata->ftdic);
@@ -439,6 +442,19 @@ static int avrftdi_transmit_mpsse(avrftdi_t* pdata, unsigned char mode, const un
 		if (mode & MPSSE_DO_READ) {
 			int n;
 			size_t k = 0;
+
+			/* send the next block before reading this one back, so the MPSSE
+			 * engine need not wait for the host between blocks. This is safe
+			 * when the next block fits into the chip's input buffer: the
+			 * current block's answer fits into its output buffer, so the
+			 * current block gets processed and the input buffer drains.
+			 */
+			ahead = MIN(remaining - transfer_size, blocksize);
+			if(ahead > (size_t) pdata->tx_buffer_size)
+				ahead = 0;
+			if(ahead)
+				E((size_t) ftdi_write_data(pdata->ftdic, (unsigned char*)&buf[written + transfer_size], ahead) != ahead, pdata->ftdic);
+
 			do {
 				n = ftdi_read_data(pdata->ftdic, &data[written + k], transfer_size - k);
 				E(n < 0, pdata->ftdic);
@@ -454,10 +470,77 @@ static int avrftdi_transmit_mpsse(avrftdi_t* pdata, unsigned char mode, const un
 	return written;
 }
 
+/* Send the queued flash page writes to the chip */
+static int avrftdi_stream_flush(avrftdi_t* pdata)
+{
+	size_t sent = 0;
+
+	while(sent < pdata->stream_len) {
+		/* one MPSSE command transfers at most 64k bytes */
+		int n = MIN(pdata->stream_len - sent, 65536);
+
+		if(avrftdi_transmit_mpsse(pdata, MPSSE_DO_WRITE, &pdata->stream[sent], NULL, n) < 0) {
+			pdata->stream_len = 0;
+			return -1;
+		}
+		sent += n;
+	}
+	pdata->stream_len = 0;
+
+	return 0;
+}
+
+/*
+ * Queue 'buf_size' bytes of MPSSE write data followed by 'delay' us of SPI
+ * clocks. The delay is made up of Poll RDY/BSY instructions (0xf0 0x00 0x00
+ * 0x00), which the AVR answers while it is busy programming; plain MPSSE
+ * clock commands would shift undefined bits into the AVR instead.
+ */
+static int avrftdi_stream_queue(avrftdi_t* pdata, const unsigned char *buf, size_t buf_size,
+			    unsigned int delay)
+{
+	size_t npoll = ((uint64_t) delay * pdata->sck_freq + 32000000 - 1) / 32000000;
+	size_t need = buf_size + 4 * npoll;
+
+	if(pdata->stream_len && pdata->stream_len + need > AVRFTDI_STREAM_SIZE)
+		if(avrftdi_stream_flush(pdata) < 0)
+			return -1;
+
+	if(pdata->stream_len + need > pdata->stream_size) {
+		size_t size = MAX(pdata->stream_len + need, AVRFTDI_STREAM_SIZE);
+		unsigned char *stream = realloc(pdata->stream, size);
+
+		if(!stream) {
+			log_err("Error allocating memory.\n");
+			return -1;
+		}
+		pdata->stream = stream;
+		pdata->stream_size = size;
+	}
+
+	memcpy(&pdata->stream[pdata->stream_len], buf, buf_size);
+	pdata->stream_len += buf_size;
+	for(size_t i = 0; i < npoll; i++) {
+		unsigned char *poll = &pdata->stream[pdata->stream_len];
+
+		poll[0] = 0xf0;
+		poll[1] = poll[2] = poll[3] = 0x00;
+		pdata->stream_len += 4;
+	}
+
+	return 0;
+}
+
 static inline int avrftdi_transmit(const PROGRAMMER *pgm, unsigned char mode, const unsigned char *buf,
 			    unsigned char *data, int buf_size)
 {
 	avrftdi_t* pdata = to_pdata(pgm);
+
+	/* any command might change memory contents: drop the flash read ahead */
+	pdata->ra_len = 0;
+	if(pdata->stream_len && avrftdi_stream_flush(pdata) < 0)
+		return -1;
+
 	if (pdata->use_bitbanging)
 		return avrftdi_transmit_bb(pgm, mode, buf, data, buf_size);
 	else
@@ -468,6 +551,10 @@ static int write_flush(avrftdi_t* pdata)
 {
 	unsigned char buf[6];
 
+	/* queued page writes must complete before pins change, eg, for reset */
+	if(pdata->stream_len && avrftdi_stream_flush(pdata) < 0)
+		return -1;
+
 	log_debug("Setting pin direction (0x%04x) and value (0x%04x)\n",
 	          pdata->pin_direction, pdata->pin_value);
 
@@ -977,6 +1064,7 @@ static int avrftdi_eeprom_read(const PROGRAMMER *pgm, const AVRPART *p, const AV
 static int avrftdi_flash_write(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
 		unsigned int page_size, unsigned int addr, unsigned int len)
 {
+	avrftdi_t* pdata = to_pdata(pgm);
 	unsigned int word;
 	unsigned int poll_index;
 
@@ -1046,7 +1134,19 @@ static int avrftdi_flash_write(const PROGRAMMER *pgm, const AVRPART *p, const AV
 		if(m->buf[poll_index] != 0xff)
 			break;
 
-	if(poll_index+1 > addr) {
+	if(poll_index+1 > addr && !pdata->use_bitbanging && m->max_write_delay > 0) {
+		buf_size = bufptr - buf;
+
+		if(verbose > TRACE)
+			buf_dump(buf, buf_size, "command buffer", 0, 16*2);
+
+		/* queue the page and its write delay behind earlier pages */
+		log_info("Queueing buffer of size: %d\n", buf_size);
+		pdata->ra_len = 0;
+		if (0 > avrftdi_stream_queue(pdata, buf, buf_size, m->max_write_delay))
+			return -1;
+	}
+	else if(poll_index+1 > addr) {
 		buf_size = bufptr - buf;
 
 		if(verbose > TRACE)
@@ -1081,10 +1181,11 @@ static int avrftdi_flash_write(const PROGRAMMER *pgm, const AVRPART *p, const AV
 }
 
 /*
- *Reading from flash
+ * Read len flash bytes from addr into dest; addr and len are even and the
+ * range must not cross a 128k boundary of the extended address
  */
-static int avrftdi_flash_read(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
-		unsigned int page_size, unsigned int addr, unsigned int len)
+static int avrftdi_flash_fetch(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
+		unsigned int addr, unsigned int len, unsigned char *dest)
 {
 	OPCODE * readop;
 
@@ -1096,16 +1197,6 @@ static int avrftdi_flash_read(const PROGRAMMER *pgm, const AVRPART *p, const AVR
 	memset(o_buf, 0, buf_size);
 	memset(i_buf, 0, buf_size);
 
-	/* pre-check opcodes */
-	if (m->op[AVR_OP_READ_LO] == NULL) {
-		log_err("AVR_OP_READ_LO command not defined for %s\n", p->desc);
-		return -1;
-	}
-	if (m->op[AVR_OP_READ_HI] == NULL) {
-		log_err("AVR_OP_READ_HI command not defined for %s\n", p->desc);
-		return -1;
-	}
-	
 	if(avrftdi_lext(pgm, p, m, addr/2) < 0)
 		return -1;
 	
@@ -1128,33 +1219,86 @@ static int avrftdi_flash_read(const PROGRAMMER *pgm, const AVRPART *p, const AVR
 	 * subsequently fail.
 	 */
 	if(verbose > TRACE) {
-		buf_dump(o_buf, sizeof(o_buf), "o_buf", 0, 32);
+		buf_dump(o_buf, len * 4, "o_buf", 0, 32);
 	}
 
 	if (0 > avrftdi_transmit(pgm, MPSSE_DO_READ | MPSSE_DO_WRITE, o_buf, i_buf, len * 4))
 		return -1;
 
 	if(verbose > TRACE) {
-		buf_dump(i_buf, sizeof(i_buf), "i_buf", 0, 32);
+		buf_dump(i_buf, len * 4, "i_buf", 0, 32);
 	}
 
-	memset(&m->buf[addr], 0, page_size);
+	memset(dest, 0, len);
 
 	/* every (read) op is 4 bytes in size and yields one byte of memory data */
-	for(unsigned int byte = 0; byte < page_size; byte++) {
+	for(unsigned int byte = 0; byte < len; byte++) {
 		if(byte & 1)
 			readop = m->op[AVR_OP_READ_HI];
 		else
 			readop = m->op[AVR_OP_READ_LO];
 
 		/* take 4 bytes and put the memory byte in the buffer at
-		 * offset addr + offset of the current byte
+		 * offset of the current byte
 		 */
-		avr_get_output(readop, &i_buf[byte*4], &m->buf[addr+byte]);
+		avr_get_output(readop, &i_buf[byte*4], &dest[byte]);
+	}
+
+	return len;
+}
+
+/*
+ *Reading from flash
+ *
+ * A paged load that continues where the previous one stopped reads ahead
+ * up to AVRFTDI_READAHEAD bytes in one transfer, so sequential reads of the
+ * whole flash are not slowed down by one USB round trip per page.
+ */
+static int avrftdi_flash_read(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
+		unsigned int page_size, unsigned int addr, unsigned int len)
+{
+	avrftdi_t* pdata = to_pdata(pgm);
+	unsigned int end;
+
+	/* pre-check opcodes */
+	if (m->op[AVR_OP_READ_LO] == NULL) {
+		log_err("AVR_OP_READ_LO command not defined for %s\n", p->desc);
+		return -1;
+	}
+	if (m->op[AVR_OP_READ_HI] == NULL) {
+		log_err("AVR_OP_READ_HI command not defined for %s\n", p->desc);
+		return -1;
+	}
+
+	if(pdata->ra_len && pdata->ra_mem == m && addr >= pdata->ra_addr &&
+	   addr + len <= pdata->ra_addr + pdata->ra_len) {
+		memcpy(&m->buf[addr], &pdata->ra_buf[addr - pdata->ra_addr], len);
+		pdata->ra_next = addr + len;
+		return len;
+	}
+
+	if(pdata->use_bitbanging || pdata->ra_mem != m || addr != pdata->ra_next ||
+	   len > AVRFTDI_READAHEAD) {
+		/* not a sequential read: fetch just the requested bytes */
+		if(avrftdi_flash_fetch(pgm, p, m, addr, len, &m->buf[addr]) < 0)
+			return -1;
+	} else {
+		/* stay within memory and the 128k window of the extended address */
+		end = MIN(addr + AVRFTDI_READAHEAD, (unsigned int) m->size);
+		end = MIN(end, (addr | 0x1ffff) + 1);
+		if(end < addr + len)
+			end = addr + len;
+		if(avrftdi_flash_fetch(pgm, p, m, addr, end - addr, pdata->ra_buf) < 0)
+			return -1;
+		pdata->ra_addr = addr;
+		pdata->ra_len = end - addr;
+		memcpy(&m->buf[addr], pdata->ra_buf, len);
 	}
+	pdata->ra_mem = m;
+	pdata->ra_next = addr + len;
 
 	if(verbose > TRACE)
-		buf_dump(&m->buf[addr], page_size, "page:", 0, 32);
+		buf_dump(&m->buf[addr], len, "page:", 0, 32);
 
 	return len;
 }
@@ -1215,6 +1359,7 @@ avrftdi_teardown(PROGRAMMER * pgm)
 	if(pdata) {
 		ftdi_deinit(pdata->ftdic);
 		ftdi_free(pdata->ftdic);
+		free(pdata->stream);
 		free(pdata);
 	}
 }
@@ -62,6 +62,11 @@ enum { ERR, WARN, INFO, DEBUG, TRACE };
   } while(0)
 
 
+/* max size of the flash page write stream before it is sent to the chip */
+#define AVRFTDI_STREAM_SIZE 65536
+/* max number of flash bytes read ahead of sequential paged loads */
+#define AVRFTDI_READAHEAD 4096
+
 #define to_pdata(pgm) \
   ((avrftdi_t *)((pgm)->cookie))
 
@@ -84,6 +89,15 @@ typedef struct avrftdi_s {
   bool use_bitbanging;
   /* bits 16-23 of extended 24-bit word flash address for parts with flash > 128k */
   uint8_t lext_byte;
+  /* SPI clock frequency in Hz as set up in the chip */
+  uint32_t sck_freq;
+  /* queued MPSSE write data of flash page writes, sent before any other command */
+  unsigned char *stream;
+  size_t stream_len, stream_size;
+  /* flash read ahead of sequential paged loads: ra_len bytes from ra_addr of ra_mem */
+  const AVRMEM *ra_mem;
+  unsigned int ra_addr, ra_len, ra_next;
+  unsigned char ra_buf[AVRFTDI_READAHEAD];
 } avrftdi_t;
 
 void avrftdi_log(int level, const char * func, int line, const char * fmt, ...);
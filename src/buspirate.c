@@ -877,8 +877,7 @@ static int buspirate_paged_load(const PROGRAMMER *pgm, const AVRPART *p, const A
   unsigned int page_size, unsigned int address, unsigned int n_bytes) {
 
 	unsigned char commandbuf[10];
-	unsigned char buf[275];
-	unsigned int addr = 0;
+	unsigned char buf[2];
 
 	msg_notice("buspirate_paged_load(..,%s,%d,%d,%d)\n",m->desc,m->page_size,address,n_bytes);
 
@@ -910,16 +909,15 @@ static int buspirate_paged_load(const PROGRAMMER *pgm, const AVRPART *p, const A
 	commandbuf[9] = (n_bytes) & 0xff;
 
 	buspirate_send_bin(pgm, commandbuf, 10);
-	buspirate_recv_bin(pgm, buf, 1);
-	buspirate_recv_bin(pgm, buf, 1);
-
-	if (buf[0] != 0x01) {
+	if (buspirate_recv_bin(pgm, buf, 2) == EOF || buf[1] != 0x01) {
 		pmsg_error("Paged Read command returned zero\n");
 		return -1;
 	}
 
-	for (addr = 0; addr < n_bytes; addr++) {
-		buspirate_recv_bin(pgm, &m->buf[addr+address], 1);
+	/* Receive the data in one go straight into the memory buffer */
+	if (buspirate_recv_bin(pgm, &m->buf[address], n_bytes) == EOF) {
+		pmsg_error("Paged Read did not return all %u bytes\n", n_bytes);
+		return -1;
 	}
 
 	return n_bytes;
@@ -932,8 +930,10 @@ static int buspirate_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const
 	int addr = base_addr;
 	int n_page_writes;
 	int this_page_size;
-	unsigned char cmd_buf[4096] = {'\0'};
-	unsigned char send_byte, recv_byte;
+	unsigned char cmd_buf[5 + 4096] = {'\0'}, *spi = cmd_buf + 5;
+	unsigned char recv_byte;
+	OPCODE *wp, *lext;
+	int n_spi, inline_wp = 4*page_size + 8 <= 4096; /* Write page fits into burst */
 
 	if (!(PDATA(pgm)->flag & BP_FLAG_IN_BINMODE)) {
 		/* Return if we are not in binary mode. */
@@ -964,6 +964,11 @@ static int buspirate_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const
 		pmsg_error("AVR_OP_LOADPAGE_HI command not defined for %s\n", p->desc);
 		return -1;
 	}
+	if ((wp = m->op[AVR_OP_WRITEPAGE]) == NULL) {
+		pmsg_error("AVR_OP_WRITEPAGE command not defined for %s\n", p->desc);
+		return -1;
+	}
+	lext = m->op[AVR_OP_LOAD_EXT_ADDR];
 
 	/* Calculate total number of page writes needed: */
 	n_page_writes = n_data_bytes/page_size;
@@ -981,43 +986,50 @@ static int buspirate_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const
 		if (page == n_page_writes-1)
 			this_page_size = n_data_bytes - page_size*page;
 
-		/* Set up command buffer: */
-		memset(cmd_buf, 0, 4*this_page_size);
+		/* Set up SPI burst: load page instructions ... */
+		memset(spi, 0, 4*this_page_size + (inline_wp? 8: 0));
 		for (i=0; i<this_page_size; i++) {
 
 			addr = base_addr + page*page_size + i;
 
 			if (i%2 == 0) {
-				avr_set_bits(m->op[AVR_OP_LOADPAGE_LO], &(cmd_buf[4*i]));
-				avr_set_addr(m->op[AVR_OP_LOADPAGE_LO], &(cmd_buf[4*i]), addr/2);
-				avr_set_input(m->op[AVR_OP_LOADPAGE_LO], &(cmd_buf[4*i]), m->buf[addr]);
+				avr_set_bits(m->op[AVR_OP_LOADPAGE_LO], &(spi[4*i]));
+				avr_set_addr(m->op[AVR_OP_LOADPAGE_LO], &(spi[4*i]), addr/2);
+				avr_set_input(m->op[AVR_OP_LOADPAGE_LO], &(spi[4*i]), m->buf[addr]);
 			} else {
-				avr_set_bits(m->op[AVR_OP_LOADPAGE_HI], &(cmd_buf[4*i]));
-				avr_set_addr(m->op[AVR_OP_LOADPAGE_HI], &(cmd_buf[4*i]), addr/2);
-				avr_set_input(m->op[AVR_OP_LOADPAGE_HI], &(cmd_buf[4*i]), m->buf[addr]);
+				avr_set_bits(m->op[AVR_OP_LOADPAGE_HI], &(spi[4*i]));
+				avr_set_addr(m->op[AVR_OP_LOADPAGE_HI], &(spi[4*i]), addr/2);
+				avr_set_input(m->op[AVR_OP_LOADPAGE_HI], &(spi[4*i]), m->buf[addr]);
 			}
 		}
+		n_spi = 4*this_page_size;
+
+		/* ... followed by load extended address and write page, so that
+		   the whole page costs one round trip rather than two or three */
+		addr = (base_addr + page*page_size)/2;
+		if (inline_wp && lext) {
+			avr_set_bits(lext, &spi[n_spi]);
+			avr_set_addr(lext, &spi[n_spi], addr);
+			n_spi += 4;
+		}
+		if (inline_wp) {
+			avr_set_bits(wp, &spi[n_spi]);
+			avr_set_addr(wp, &spi[n_spi], addr);
+			n_spi += 4;
+		}
 
-		/* 00000100 - Write then read */
-		send_byte = 0x05;
-		buspirate_send_bin(pgm, &send_byte, 1);
-
-		/* Number of bytes to write: */
-		send_byte = (4*this_page_size)/0x100;
-		buspirate_send_bin(pgm, &send_byte, 1); /* High byte */
-		send_byte = (4*this_page_size)%0x100;
-		buspirate_send_bin(pgm, &send_byte, 1); /* Low byte */
-
-		/* Number of bytes to read: */
-		send_byte = 0x0;
-		buspirate_send_bin(pgm, &send_byte, 1); /* High byte */
-		buspirate_send_bin(pgm, &send_byte, 1); /* Low byte */
+		/* 00000101 - Write then read (no CS), number of bytes to write and to read */
+		cmd_buf[0] = 0x05;
+		cmd_buf[1] = n_spi/0x100;
+		cmd_buf[2] = n_spi%0x100;
+		cmd_buf[3] = 0;
+		cmd_buf[4] = 0;
 
 		/* Set programming LED: */
 		pgm->pgm_led(pgm, ON);
 
-		/* Send command buffer: */
-		buspirate_send_bin(pgm, cmd_buf, 4*this_page_size);
+		/* Send header and SPI burst in one go: */
+		buspirate_send_bin(pgm, cmd_buf, 5 + n_spi);
 
 		/* Check for write failure: */
 		if ((buspirate_recv_bin(pgm, &recv_byte, 1) == EOF) || (recv_byte != 0x01)) {
@@ -1027,11 +1039,16 @@ static int buspirate_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const
 			return -1;
 		}
 
+		/* Wait for the page write to complete as avr_write_page() does */
+		if (inline_wp)
+			usleep(m->max_write_delay);
+
 		/* Unset programming LED: */
 		pgm->pgm_led(pgm, OFF);
 
-		/* Write loaded page to flash: */
-		avr_write_page(pgm, p, m, addr);
+		/* Write loaded page to flash if it did not fit into the burst: */
+		if (!inline_wp)
+			avr_write_page(pgm, p, m, base_addr + page*page_size);
 	}
 
 	return n_data_bytes;
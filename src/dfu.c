@@ -84,6 +84,8 @@ int dfu_upload(struct dfu_dev *dfu, void * ptr, int size) {
 #define DFU_GETSTATE 5          /* FLIPv1 only; not used */
 #define DFU_ABORT 6             /* FLIPv1 only */
 
+#define DFU_FUNCTIONAL_DESCRIPTOR 0x21
+
 /* Block counter global variable. Incremented each time a DFU_DNLOAD command
  * is sent to the device.
  */
@@ -94,6 +96,7 @@ static uint16_t wIndex = 0;
  */
 
 static char * get_usb_string(usb_dev_handle * dev_handle, int index);
+static unsigned int get_xfer_size(const unsigned char *extra, int len);
 
 /* EXPORTED FUNCTION DEFINITIONS
  */
@@ -232,6 +235,15 @@ int dfu_init(struct dfu_dev *dfu, unsigned short vid, unsigned short pid)
       memcpy(&dfu->endp_desc, found->config->interface->altsetting->endpoint,
              sizeof(dfu->endp_desc));
 
+  /* The DFU functional descriptor normally follows the interface descriptor,
+   * but some devices put it after the configuration descriptor.
+   */
+
+  dfu->xfer_size = get_xfer_size(found->config->interface->altsetting->extra,
+    found->config->interface->altsetting->extralen);
+  if (dfu->xfer_size == 0)
+    dfu->xfer_size = get_xfer_size(found->config->extra, found->config->extralen);
+
   /* Get strings. */
 
   dfu->manf_str = get_usb_string(dfu->dev_handle,
@@ -412,6 +424,9 @@ void dfu_show_info(struct dfu_dev *dfu)
 
   if (dfu->serno_str != NULL)
     msg_info("    USB Serial No       : %s\n", dfu->serno_str);
+
+  if (dfu->xfer_size != 0)
+    msg_info("    DFU transfer size   : %u\n", dfu->xfer_size);
 }
 
 /* INTERNAL FUNCTION DEFINITIONS
@@ -444,6 +459,21 @@ char * get_usb_string(usb_dev_handle * dev_handle, int index) {
   return str;
 }
 
+/* Return wTransferSize of the DFU functional descriptor among the
+ * class-specific descriptors in extra, or 0 if there is none.
+ */
+
+unsigned int get_xfer_size(const unsigned char *extra, int len) {
+  while (extra != NULL && len >= 2 && extra[0] >= 2 && extra[0] <= len) {
+    if (extra[1] == DFU_FUNCTIONAL_DESCRIPTOR && extra[0] >= 7)
+      return extra[5] | (extra[6] << 8);
+    len -= extra[0];
+    extra += extra[0];
+  }
+
+  return 0;
+}
+
 #endif /* defined(HAVE_LIBUSB) */
 
 /* EXPORTED FUNCTIONS THAT DO NO REQUIRE LIBUSB
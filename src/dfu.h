@@ -56,6 +56,7 @@ struct dfu_dev
   struct usb_endpoint_descriptor endp_desc;
   char *manf_str, *prod_str, *serno_str;
   unsigned int timeout;
+  unsigned int xfer_size;       /* wTransferSize from the DFU functional descriptor, 0 if none */
 };
 
 #else
@@ -27,6 +27,7 @@
 #include <errno.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <sys/stat.h>
 
 #ifdef HAVE_LIBELF
 #ifdef HAVE_LIBELF_H
@@ -44,6 +45,7 @@
 
 #include "avrdude.h"
 #include "libavrdude.h"
+#include "crc16.h"
 
 
 #define IHEX_MAXDATA 256
@@ -62,7 +64,7 @@ struct ihexrec {
 
 static int b2ihex(const unsigned char *inbuf, int bufsize,
              int recsize, int startaddr,
-             const char *outfile, FILE *outf, FILEFMT ffmt);
+             const char *outfile, FILE *outf, FILEFMT ffmt, int skipff);
 
 static int ihex2b(const char *infile, FILE *inf,
              const AVRMEM *mem, int bufsize, unsigned int fileoffset,
@@ -70,7 +72,7 @@ static int ihex2b(const char *infile, FILE *inf,
 
 static int b2srec(const unsigned char *inbuf, int bufsize,
              int recsize, int startaddr,
-             const char *outfile, FILE *outf);
+             const char *outfile, FILE *outf, int skipff);
 
 static int srec2b(const char *infile, FILE *inf,
              const AVRMEM *mem, int bufsize, unsigned int fileoffset);
@@ -89,6 +91,10 @@ static int fileio_ihex(struct fioparms *fio,
 static int fileio_srec(struct fioparms *fio,
              const char *filename, FILE *f, const AVRMEM *mem, int size);
 
+static int fileio_sparse(struct fioparms *fio,
+             const char *filename, FILE *f, const AVRMEM *mem,
+             const AVRPART *p, int size);
+
 #ifdef HAVE_LIBELF
 static int elf2b(const char *infile, FILE *inf,
                  const AVRMEM *mem, const AVRPART *p,
@@ -113,25 +119,103 @@ char * fileio_fmtstr(FILEFMT format)
     case FMT_IHXC : return "Intel Hex with comments"; break;
     case FMT_RBIN : return "raw binary"; break;
     case FMT_ELF  : return "ELF"; break;
+    case FMT_SPARSE: return "sparse binary image"; break;
     default       : return "invalid format"; break;
   };
 }
 
 
+/*
+ * Text output formats are assembled in a large buffer using a hex digit
+ * table rather than one fprintf() per byte, and the buffer is handed to
+ * fwrite() whenever it fills up. Callers reserve room for one complete
+ * record with ob_room() before formatting it.
+ */
+#define OUTBUF_SIZE 65536
+
+typedef struct {
+  FILE *f;
+  int len;                      // Number of characters in buf[]
+  int err;                      // Set once fwrite() failed
+  char buf[OUTBUF_SIZE];
+} Outbuf;
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+static Outbuf *ob_open(FILE *f) {
+  Outbuf *ob = cfg_malloc(__func__, sizeof *ob);
+  ob->f = f;
+  return ob;
+}
+
+static void ob_flush(Outbuf *ob) {
+  if (ob->len && !ob->err && fwrite(ob->buf, 1, ob->len, ob->f) != (size_t) ob->len)
+    ob->err = 1;
+  ob->len = 0;
+}
+
+// Return pointer to the end of the buffer after ensuring room for n characters
+static char *ob_room(Outbuf *ob, int n) {
+  if (ob->len + n > OUTBUF_SIZE)
+    ob_flush(ob);
+  return ob->buf + ob->len;
+}
+
+// Mark the buffer as filled up to (but not including) end
+static void ob_fill(Outbuf *ob, const char *end) {
+  ob->len = end - ob->buf;
+}
+
+// Flush and free the output buffer; return -1 on write error, 0 otherwise
+static int ob_close(Outbuf *ob, const char *outfile) {
+  ob_flush(ob);
+  int err = ob->err;
+  free(ob);
+  if (err) {
+    pmsg_ext_error("unable to write to %s: %s\n", outfile, strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+// Put n lower hex digits of val, most significant first
+static char *ob_hex(char *p, unsigned int val, int n) {
+  while (n--)
+    *p++ = hexdigits[(val >> 4*n) & 15];
+  return p;
+}
+
+static int is_all_ff(const unsigned char *buf, int n) {
+  while (n--)
+    if (*buf++ != 0xff)
+      return 0;
+  return 1;
+}
+
+
+/*
+ * Longest record is an IHXC line: 2*255 data digits, same again for
+ * padding plus 255 ASCII dump characters and some change
+ */
+#define MAX_RECORD_LEN 1400
+
 static int b2ihex(const unsigned char *inbuf, int bufsize, int recsize,
-  int startaddr, const char *outfile_unused, FILE *outf, FILEFMT ffmt) {
+  int startaddr, const char *outfile, FILE *outf, FILEFMT ffmt, int skipff) {
 
   const unsigned char *buf;
   unsigned int nextaddr;
   int n, nbytes, n_64k;
   int i;
   unsigned char cksum;
+  Outbuf *ob;
+  char *p;
 
   if (recsize > 255) {
     pmsg_error("recsize=%d, must be < 256\n", recsize);
     return -1;
   }
 
+  ob       = ob_open(outf);
   n_64k    = 0;
   nextaddr = startaddr;
   buf      = inbuf;
@@ -145,29 +229,37 @@ static int b2ihex(const unsigned char *inbuf, int bufsize, int recsize,
     if ((nextaddr + n) > 0x10000)
       n = 0x10000 - nextaddr;
 
-    if (n) {
-      cksum = 0;
-      fprintf(outf, ":%02X%04X00", n, nextaddr);
-      cksum += n + ((nextaddr >> 8) & 0x0ff) + (nextaddr & 0x0ff);
+    // Flash reads are 0xff filled, so all-0xff records carry no information
+    if (n && !(skipff && is_all_ff(buf, n))) {
+      p = ob_room(ob, MAX_RECORD_LEN);
+      *p++ = ':';
+      p = ob_hex(p, n, 2);
+      p = ob_hex(p, nextaddr, 4);
+      p = ob_hex(p, 0, 2);
+      cksum = n + ((nextaddr >> 8) & 0x0ff) + (nextaddr & 0x0ff);
       for (i=0; i<n; i++) {
-        fprintf(outf, "%02X", buf[i]);
+        p = ob_hex(p, buf[i], 2);
         cksum += buf[i];
       }
-      cksum = -cksum;
-      fprintf(outf, "%02X", cksum);
+      p = ob_hex(p, (unsigned char) -cksum, 2);
 
       if(ffmt == FMT_IHXC) { /* Print comment with address and ASCII dump */
-        for(i=n; i<recsize; i++)
-          fprintf(outf, "  ");
-        fprintf(outf, " // %05x> ", n_64k*0x10000 + nextaddr);
+        for(i=n; i<recsize; i++) {
+          *p++ = ' ';
+          *p++ = ' ';
+        }
+        p += sprintf(p, " // %05x> ", n_64k*0x10000 + nextaddr);
         for (i=0; i<n; i++) {
           unsigned char c = buf[i] & 0x7f;
           /* Print space as _ so that line is one word */
-          putc(c == ' '? '_': c < ' ' || c == 0x7f? '.': c, outf);
+          *p++ = c == ' '? '_': c < ' ' || c == 0x7f? '.': c;
         }
       }
-      putc('\n', outf);
+      *p++ = '\n';
+      ob_fill(ob, p);
+    }
 
+    if (n) {
       nextaddr += n;
       nbytes   += n;
     }
@@ -178,11 +270,14 @@ static int b2ihex(const unsigned char *inbuf, int bufsize, int recsize,
       n_64k++;
       lo = n_64k & 0xff;
       hi = (n_64k >> 8) & 0xff;
-      cksum = 0;
-      fprintf(outf, ":02000004%02X%02X", hi, lo);
-      cksum += 2 + 0 + 4 + hi + lo;
-      cksum = -cksum;
-      fprintf(outf, "%02X\n", cksum);
+      cksum = 2 + 0 + 4 + hi + lo;
+      p = ob_room(ob, MAX_RECORD_LEN);
+      memcpy(p, ":02000004", 9);
+      p = ob_hex(p+9, hi, 2);
+      p = ob_hex(p, lo, 2);
+      p = ob_hex(p, (unsigned char) -cksum, 2);
+      *p++ = '\n';
+      ob_fill(ob, p);
       nextaddr = 0;
     }
 
@@ -194,15 +289,11 @@ static int b2ihex(const unsigned char *inbuf, int bufsize, int recsize,
   /*-----------------------------------------------------------------
     add the end of record data line
     -----------------------------------------------------------------*/
-  cksum = 0;
-  n = 0;
-  nextaddr = 0;
-  fprintf(outf, ":%02X%04X01", n, nextaddr);
-  cksum += n + ((nextaddr >> 8) & 0x0ff) + (nextaddr & 0x0ff) + 1;
-  cksum = -cksum;
-  fprintf(outf, "%02X\n", cksum);
+  p = ob_room(ob, MAX_RECORD_LEN);
+  memcpy(p, ":00000001FF\n", 12);
+  ob_fill(ob, p + 12);
 
-  return nbytes;
+  return ob_close(ob, outfile) < 0? -1: nbytes;
 }
 
 
@@ -397,23 +488,25 @@ static int ihex2b(const char *infile, FILE *inf,
 }
 
 static int b2srec(const unsigned char *inbuf, int bufsize, int recsize,
-  int startaddr, const char *outfile_unused, FILE *outf) {
+  int startaddr, const char *outfile, FILE *outf, int skipff) {
 
   const unsigned char *buf;
   unsigned int nextaddr;
   int n, nbytes, addr_width;
   unsigned char cksum;
-
-  char * tmpl=0;
+  char rtype;
+  Outbuf *ob;
+  char *p;
 
   if (recsize > 255) {
     pmsg_error("recsize=%d, must be < 256\n", recsize);
     return -1;
   }
-  
+
+  ob = ob_open(outf);
   nextaddr = startaddr;
   buf = inbuf;
-  nbytes = 0;    
+  nbytes = 0;
 
   addr_width = 0;
 
@@ -424,45 +517,53 @@ static int b2srec(const unsigned char *inbuf, int bufsize, int recsize,
     if (n > bufsize) 
       n = bufsize;
 
-    if (n) {
-      cksum = 0;
+    // Flash reads are 0xff filled, so all-0xff records carry no information
+    if (n && !(skipff && is_all_ff(buf, n))) {
       if (nextaddr + n <= 0xffff) {
         addr_width = 2;
-        tmpl="S1%02X%04X";
+        rtype = '1';
       }
       else if (nextaddr + n <= 0xffffff) {
         addr_width = 3;
-        tmpl="S2%02X%06X";
+        rtype = '2';
       }
       else if (nextaddr + n <= 0xffffffff) {
         addr_width = 4;
-        tmpl="S3%02X%08X";
+        rtype = '3';
       }
       else {
         pmsg_error("address=%d, out of range\n", nextaddr);
+        ob_close(ob, outfile);
         return -1;
       }
 
-      fprintf(outf, tmpl, n + addr_width + 1, nextaddr);
+      p = ob_room(ob, MAX_RECORD_LEN);
+      *p++ = 'S';
+      *p++ = rtype;
+      p = ob_hex(p, n + addr_width + 1, 2);
+      p = ob_hex(p, nextaddr, 2*addr_width);
 
-      cksum += n + addr_width + 1;
+      cksum = n + addr_width + 1;
 
       for (int i=addr_width; i>0; i--)
         cksum += (nextaddr >> (i-1) * 8) & 0xff;
 
-      for (unsigned i=nextaddr; i<nextaddr + n; i++) {
-        fprintf(outf, "%02X", buf[i]);
+      for (int i=0; i<n; i++) {
+        p = ob_hex(p, buf[i], 2);
         cksum += buf[i];
       }
 
       cksum = 0xff - cksum;
-      fprintf(outf, "%02X\n", cksum);
-
-      nextaddr += n;
-      nbytes +=n;
+      p = ob_hex(p, cksum, 2);
+      *p++ = '\n';
+      ob_fill(ob, p);
     }
 
+    nextaddr += n;
+    nbytes += n;
+
     /* advance to next 'recsize' bytes */
+    buf += n;
     bufsize -= n;
   }
 
@@ -473,28 +574,28 @@ static int b2srec(const unsigned char *inbuf, int bufsize, int recsize,
   n = 0;
   nextaddr = 0;
 
-  if (startaddr <= 0xffff) {
+  if (startaddr <= 0xffff)
     addr_width = 2;
-    tmpl="S9%02X%04X";
-  }
-  else if (startaddr <= 0xffffff) {
+  else if (startaddr <= 0xffffff)
     addr_width = 3;
-    tmpl="S9%02X%06X";
-  }
-  else if ((unsigned) startaddr <= 0xffffffff) {
+  else
     addr_width = 4;
-    tmpl="S9%02X%08X";
-  }
 
-  fprintf(outf, tmpl, n + addr_width + 1, nextaddr);
+  p = ob_room(ob, MAX_RECORD_LEN);
+  *p++ = 'S';
+  *p++ = '9';
+  p = ob_hex(p, n + addr_width + 1, 2);
+  p = ob_hex(p, nextaddr, 2*addr_width);
 
   cksum += n + addr_width +1;
   for (int i=addr_width; i>0; i--)
     cksum += (nextaddr >> (i - 1) * 8) & 0xff;
   cksum = 0xff - cksum;
-  fprintf(outf, "%02X\n", cksum);
+  p = ob_hex(p, cksum, 2);
+  *p++ = '\n';
+  ob_fill(ob, p);
 
-  return nbytes; 
+  return ob_close(ob, outfile) < 0? -1: nbytes;
 }
 
 
@@ -683,6 +784,239 @@ static int srec2b(const char *infile, FILE * inf,
   return maxaddr;
 }
 
+
+/*
+ * Sparse binary image: like Intel Hex it only carries the bytes that
+ * were specified, but stores them as (offset, length, data) extents, so
+ * loading takes a few fread() calls straight into the memory buffer and
+ * the data could equally be mmap()ed. All numbers are little endian:
+ *
+ *   magic[8]                 "AVRSPI1\n"
+ *   sig[3]                   Signature of the part the image is for
+ *   namelen[1], name[namelen] Memory name
+ *   size[4]                  Size of that memory
+ *   nrec[4]                  Number of extents that follow
+ *   nrec x {off[4], len[4], data[len]}
+ *   crc[2]                   CRC16 of all preceding bytes, LSB first
+ */
+#define SPARSE_MAGIC "AVRSPI1\n"
+#define SPARSE_MINGAP 16        // Shorter 0xff runs of flash stay inside an extent
+
+static void sparse_set32(unsigned char *p, unsigned int v) {
+  p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static unsigned int sparse_get32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int) p[3] << 24;
+}
+
+// Write len bytes to f and update the running CRC
+static int sparse_put(FILE *f, const void *data, size_t len, unsigned short *crc) {
+  *crc = crcsum(data, len, *crc);
+  return fwrite(data, 1, len, f) == len? 0: -1;
+}
+
+// Read len bytes from f and update the running CRC
+static int sparse_get(FILE *f, void *data, size_t len, unsigned short *crc) {
+  if(fread(data, 1, len, f) != len)
+    return -1;
+  *crc = crcsum(data, len, *crc);
+  return 0;
+}
+
+/*
+ * Return length of the next extent in buf[*from, size) and set *from to
+ * its start; 0 if there is none. Without skipff everything is one extent.
+ */
+static int sparse_extent(const unsigned char *buf, int size, int skipff, int *from) {
+  int i = *from, end;
+
+  if(!skipff)
+    return i < size? size - i: 0;
+
+  while(i < size && buf[i] == 0xff)
+    i++;
+  if(i >= size)
+    return 0;
+
+  *from = i;
+  for(end = i; i < size; i++)
+    if(buf[i] != 0xff)
+      end = i+1;
+    else if(i+1 - end >= SPARSE_MINGAP)
+      break;
+
+  return end - *from;
+}
+
+
+static int b2sparse(const AVRMEM *mem, const AVRPART *p, int size,
+  const char *outfile, FILE *outf) {
+
+  unsigned char hdr[8 + 3 + 1 + 255 + 4 + 4], *q = hdr;
+  unsigned short crc = 0xffff;
+  int from, len, nrec, skipff = avr_mem_ffopt(mem);
+  size_t namelen = strlen(mem->desc);
+
+  if(namelen > 255)
+    namelen = 255;
+
+  for(nrec = 0, from = 0; (len = sparse_extent(mem->buf, size, skipff, &from)); from += len)
+    nrec++;
+
+  memcpy(q, SPARSE_MAGIC, 8), q += 8;
+  memcpy(q, p->signature, 3), q += 3;
+  *q++ = namelen;
+  memcpy(q, mem->desc, namelen), q += namelen;
+  sparse_set32(q, mem->size), q += 4;
+  sparse_set32(q, nrec), q += 4;
+  if(sparse_put(outf, hdr, q-hdr, &crc) < 0)
+    goto writeerr;
+
+  for(from = 0; (len = sparse_extent(mem->buf, size, skipff, &from)); from += len) {
+    sparse_set32(hdr, from);
+    sparse_set32(hdr+4, len);
+    if(sparse_put(outf, hdr, 8, &crc) < 0 || sparse_put(outf, mem->buf+from, len, &crc) < 0)
+      goto writeerr;
+  }
+
+  hdr[0] = crc;
+  hdr[1] = crc >> 8;
+  if(fwrite(hdr, 1, 2, outf) != 2)
+    goto writeerr;
+
+  return size;
+
+writeerr:
+  pmsg_ext_error("unable to write to %s: %s\n", outfile, strerror(errno));
+  return -1;
+}
+
+
+/*
+ * Read the next image from inf. Its extents are copied into mem if the
+ * image is for mem or if loadany is set, and if they fit; otherwise they
+ * are read and discarded. Set reset when mem may hold (part of) an earlier
+ * image that needs to be wiped before loading. The memory name and size of the image
+ * are returned in name and msize. Returns 0 at end of file, -1 on error,
+ * 1 if the image was loaded (*maxaddrp is set to its highest address + 1)
+ * and 2 otherwise.
+ */
+static int sparse_image(const char *infile, FILE *inf, const AVRMEM *mem, const AVRPART *p,
+  int bufsize, int loadany, int reset, char *name, unsigned int *msize, int *maxaddrp) {
+
+  unsigned char hdr[8 + 3 + 1], skip[256];
+  unsigned short crc = 0xffff;
+  unsigned int nrec, off, len;
+  int maxaddr = 0;
+  size_t n;
+
+  if((n = fread(hdr, 1, sizeof hdr, inf)) == 0 && feof(inf))
+    return 0;
+  crc = crcsum(hdr, n, crc);
+  if(n != sizeof hdr || memcmp(hdr, SPARSE_MAGIC, 8)) {
+    pmsg_error("%s is not a sparse binary image file\n", infile);
+    return -1;
+  }
+  if(memcmp(hdr+8, p->signature, 3))
+    pmsg_warning("%s was saved for a part with signature 0x%02x 0x%02x 0x%02x, not %s\n",
+      infile, hdr[8], hdr[9], hdr[10], p->desc);
+
+  int namelen = hdr[11];
+  if(sparse_get(inf, name, namelen, &crc) < 0 || sparse_get(inf, hdr, 8, &crc) < 0)
+    goto eof;
+  name[namelen] = 0;
+  *msize = sparse_get32(hdr);
+  nrec = sparse_get32(hdr+4);
+
+  int named = strcmp(name, mem->desc) == 0, load = loadany || named;
+  if(load && reset) {
+    memset(mem->buf, 0xff, bufsize);
+    memset(mem->tags, 0, bufsize);
+  }
+
+  for(unsigned int i = 0; i < nrec; i++) {
+    if(sparse_get(inf, hdr, 8, &crc) < 0)
+      goto eof;
+    off = sparse_get32(hdr);
+    len = sparse_get32(hdr+4);
+    if(load && (off > (unsigned int) bufsize || len > bufsize - off)) {
+      if(named)
+        pmsg_error("extent [0x%04x, 0x%04x] of %s does not fit into %s [0, 0x%04x]\n",
+          off, off+len-1, infile, mem->desc, bufsize-1);
+      load = 0;
+    }
+    if(load) {
+      if(sparse_get(inf, mem->buf+off, len, &crc) < 0)
+        goto eof;
+      memset(mem->tags+off, TAG_ALLOCATED, len);
+      if((int) (off+len) > maxaddr)
+        maxaddr = off+len;
+    } else {                    // Read in chunks rather than seek as the CRC covers skipped extents
+      for(unsigned int k = 0; k < len; k += sizeof skip)
+        if(sparse_get(inf, skip, len-k < sizeof skip? len-k: sizeof skip, &crc) < 0)
+          goto eof;
+    }
+  }
+
+  if(fread(hdr, 1, 2, inf) != 2)
+    goto eof;
+  if(hdr[0] != (crc & 0xff) || hdr[1] != crc >> 8) {
+    pmsg_error("CRC mismatch in sparse binary image file %s\n", infile);
+    return -1;
+  }
+
+  *maxaddrp = maxaddr;
+  return load? 1: 2;
+
+eof:
+  pmsg_error("premature end of file %s\n", infile);
+  return -1;
+}
+
+
+/*
+ * A sparse binary image file can hold images of several memories (see
+ * update.c's -U all:r:...). Load the one that carries the name of mem;
+ * failing that, a file with a single image of another memory is loaded
+ * into mem after a warning.
+ */
+static int sparse2b(const char *infile, FILE *inf, const AVRMEM *mem,
+  const AVRPART *p, int bufsize) {
+
+  char name[256];
+  unsigned int msize;
+  int rc, nimg = 0, loaded = 0, maxaddr = 0, ma = 0;
+
+  while((rc = sparse_image(infile, inf, mem, p, bufsize, nimg == 0, nimg > 0, name, &msize, &ma)) > 0) {
+    nimg++;
+    if(rc == 1) {
+      loaded = 1;
+      maxaddr = ma;
+      if(strcmp(name, mem->desc) == 0) {
+        if(msize != (unsigned int) mem->size)
+          pmsg_warning("%s holds %s memory of size %u, loading it into %s of size %d\n",
+            infile, name, msize, mem->desc, mem->size);
+        return maxaddr;
+      }
+    }
+  }
+  if(rc < 0)
+    return -1;
+
+  if(nimg == 1 && loaded) {
+    pmsg_warning("%s holds %s memory of size %u, loading it into %s of size %d\n",
+      infile, name, msize, mem->desc, mem->size);
+    return maxaddr;
+  }
+
+  if(nimg == 1 && strcmp(name, mem->desc))
+    pmsg_error("%s memory image in %s does not fit into %s\n", name, infile, mem->desc);
+  else if(nimg != 1)
+    pmsg_error("%s has no image of %s memory\n", infile, mem->desc);
+  return -1;
+}
+
 #ifdef HAVE_LIBELF
 /*
  * Determine whether the ELF file section pointed to by `sh' fits
@@ -777,38 +1111,59 @@ static int elf_mem_limits(const AVRMEM *mem, const AVRPART *p,
 }
 
 
-static int elf2b(const char *infile, FILE *inf, const AVRMEM *mem,
-  const AVRPART *p, int bufsize_unused, unsigned int fileoffset_unused) {
+/*
+ * ELF files are indexed once per run: the first elf2b() call for a file
+ * reads all loadable sections together with their load addresses, and
+ * later calls for other memories (eg, -U flash, -U eeprom, -U lfuse from
+ * the same .elf) only copy the matching sections from the index, so the
+ * file is neither reopened nor walked again.  The index remembers the
+ * file status so that a file rewritten during the run is indexed anew.
+ */
+typedef struct {
+  const char *name;             // Section name
+  unsigned int lma, size;       // Load memory address and size of section
+  unsigned char *data;          // Section contents
+} Elfsect;
+
+static struct {
+  char *fname;                  // Name of indexed file, NULL if none or from stdin
+  struct stat st;               // File status at time of indexing
+  int avr32;                    // Index made for an AVR32 part
+  int nsect;                    // Number of entries in sect[]
+  Elfsect *sect;
+} elfidx;
+
+
+static void elf_index_free(void) {
+  for(int i = 0; i < elfidx.nsect; i++) {
+    free((char *) elfidx.sect[i].name);
+    free(elfidx.sect[i].data);
+  }
+  free(elfidx.sect);
+  free(elfidx.fname);
+  memset(&elfidx, 0, sizeof elfidx);
+}
 
-  Elf *e;
-  int rv = 0, size = 0;
-  unsigned int low, high, foff;
 
-  if (elf_mem_limits(mem, p, &low, &high, &foff) != 0) {
-    pmsg_error("cannot handle %s memory region from ELF file\n", mem->desc);
-    return -1;
-  }
+// Is there a current index of file fname made for part p?
+static int elf_index_valid(const char *fname, const AVRPART *p) {
+  struct stat st;
+
+  if(!elfidx.fname || strcmp(elfidx.fname, fname) || stat(fname, &st) < 0)
+    return 0;
+
+  return st.st_size == elfidx.st.st_size && st.st_mtime == elfidx.st.st_mtime &&
+    st.st_ino == elfidx.st.st_ino && st.st_dev == elfidx.st.st_dev &&
+    elfidx.avr32 == !!(p->prog_modes & PM_aWire);
+}
 
-  /*
-   * The Xmega memory regions for "boot", "application", and
-   * "apptable" are actually sub-regions of "flash".  Refine the
-   * applicable limits.  This allows to select only the appropriate
-   * sections out of an ELF file that contains section data for more
-   * than one sub-segment.
-   */
-  if ((p->prog_modes & PM_PDI) != 0 &&
-      (strcmp(mem->desc, "boot") == 0 ||
-       strcmp(mem->desc, "application") == 0 ||
-       strcmp(mem->desc, "apptable") == 0)) {
-    AVRMEM *flashmem = avr_locate_mem(p, "flash");
-    if (flashmem == NULL) {
-      pmsg_error("no flash memory region found, cannot compute bounds of %s sub-region\n", mem->desc);
-      return -1;
-    }
-    /* The config file offsets are PDI offsets, rebase to 0. */
-    low = mem->offset - flashmem->offset;
-    high = low + mem->size - 1;
-  }
+
+// Read all PT_LOAD program sections of the ELF file inf into elfidx
+static int elf_index(const char *infile, FILE *inf, const AVRPART *p) {
+  Elf *e;
+  int rv = -1, nalloc = 0;
+
+  elf_index_free();
 
   if (elf_version(EV_CURRENT) == EV_NONE) {
     pmsg_error("ELF library initialization failed: %s\n", elf_errmsg(-1));
@@ -888,6 +1243,7 @@ static int elf2b(const char *infile, FILE *inf, const AVRMEM *mem,
     sndx = 0;
   }
 
+  rv = 0;
   /*
    * Walk the program header table, pick up entries that are of type
    * PT_LOAD, and have a non-zero p_filesz.
@@ -919,68 +1275,143 @@ static int elf2b(const char *infile, FILE *inf, const AVRMEM *mem,
       if (!is_section_in_segment(sh, ph+i))
         continue;
 
-      const char *sname = sndx? elf_strptr(e, sndx, sh->sh_name): "*unknown*";
+      const char *sname = sndx? elf_strptr(e, sndx, sh->sh_name): NULL;
       unsigned int lma = ph[i].p_paddr + sh->sh_offset - ph[i].p_offset;
 
-      pmsg_notice2("found section %s, LMA 0x%x, sh_size %u\n", sname, lma, sh->sh_size);
+      pmsg_notice2("found section %s, LMA 0x%x, sh_size %u\n", sname? sname: "*unknown*", lma, sh->sh_size);
 
-      if(!(lma >= low && lma + sh->sh_size < high)) {
-        imsg_notice2("skipping %s (inappropriate for %s)\n", sname, mem->desc);
-        continue;
-      }
-      /*
-       * 1-byte sized memory regions are special: they are used for fuse
-       * bits, where multiple regions (in the config file) map to a
-       * single, larger region in the ELF file (e.g. "lfuse", "hfuse",
-       * and "efuse" all map to ".fuse").  We silently accept a larger
-       * ELF file region for these, and extract the actual byte to write
-       * from it, using the "foff" offset obtained above.
-       */
-      if (mem->size != 1 && sh->sh_size > (unsigned) mem->size) {
-        pmsg_error("section %s of size %u does not fit into %s of size %d\n",
-          sname, sh->sh_size, mem->desc, mem->size);
-        rv = -1;
-        continue;
+      if (elfidx.nsect == nalloc) {
+        nalloc = nalloc? 2*nalloc: 8;
+        Elfsect *sect = cfg_malloc(__func__, nalloc*sizeof *sect);
+        if (elfidx.nsect)
+          memcpy(sect, elfidx.sect, elfidx.nsect*sizeof *sect);
+        free(elfidx.sect);
+        elfidx.sect = sect;
       }
+      Elfsect *es = elfidx.sect + elfidx.nsect++;
+      es->name = cfg_strdup(__func__, sname? sname: "*unknown*");
+      es->lma = lma;
+      es->size = sh->sh_size;
+      es->data = cfg_malloc(__func__, es->size); // Zero-filled where there are no data blocks
 
       Elf_Data *d = NULL;
       while ((d = elf_getdata(scn, d)) != NULL) {
         imsg_notice2("data block: d_buf %p, d_off 0x%x, d_size %ld\n",
           d->d_buf, (unsigned int)d->d_off, (long) d->d_size);
-        if (mem->size == 1) {
-          if (d->d_off != 0) {
-            pmsg_error("unexpected data block at offset != 0\n");
-            rv = -1;
-          } else if (foff >= d->d_size) {
-            pmsg_error("ELF file section does not contain byte at offset %d\n", foff);
-            rv = -1;
-          } else {
-            imsg_notice2("extracting one byte from file offset %d\n", foff);
-            mem->buf[0] = ((unsigned char *)d->d_buf)[foff];
-            mem->tags[0] = TAG_ALLOCATED;
-            size = 1;
-          }
-        } else {
-          int idx = lma-low + d->d_off;
-          int end = idx + d->d_size;
-
-          if(idx >= 0 && idx < mem->size && end >= 0 && end <= mem->size && end-idx >= 0) {
-            if (end > size)
-              size = end;
-            imsg_debug("writing %d bytes to mem offset 0x%x\n", end-idx, idx);
-            memcpy(mem->buf + idx, d->d_buf, end-idx);
-            memset(mem->tags + idx, TAG_ALLOCATED, end-idx);
-          } else {
-            pmsg_error("section %s [0x%04x, 0x%04x] does not fit into %s [0, 0x%04x]\n",
-              sname, idx, (int) (idx + d->d_size-1), mem->desc, mem->size-1);
-            rv = -1;
-          }
-        }
+        if (d->d_off < 0 || d->d_off + d->d_size > es->size) {
+          pmsg_error("data block of section %s at offset 0x%x exceeds section size %u\n",
+            es->name, (unsigned int) d->d_off, es->size);
+          rv = -1;
+        } else if (d->d_buf && d->d_size)
+          memcpy(es->data + d->d_off, d->d_buf, d->d_size);
       }
     }
   }
+
 done:
   (void)elf_end(e);
+  if (rv < 0) {
+    elf_index_free();
+    return rv;
+  }
+  // Only remember regular files so later -U operations can reuse the index
+  if (inf != stdin && fstat(fileno(inf), &elfidx.st) == 0)
+    elfidx.fname = cfg_strdup(__func__, infile);
+  elfidx.avr32 = !!(p->prog_modes & PM_aWire);
+
+  return 0;
+}
+
+
+static int elf2b(const char *infile, FILE *inf, const AVRMEM *mem,
+  const AVRPART *p, int bufsize_unused, unsigned int fileoffset_unused) {
+
+  int rv = 0, size = 0;
+  unsigned int low, high, foff;
+
+  if (elf_mem_limits(mem, p, &low, &high, &foff) != 0) {
+    pmsg_error("cannot handle %s memory region from ELF file\n", mem->desc);
+    return -1;
+  }
+
+  /*
+   * The Xmega memory regions for "boot", "application", and
+   * "apptable" are actually sub-regions of "flash".  Refine the
+   * applicable limits.  This allows to select only the appropriate
+   * sections out of an ELF file that contains section data for more
+   * than one sub-segment.
+   */
+  if ((p->prog_modes & PM_PDI) != 0 &&
+      (strcmp(mem->desc, "boot") == 0 ||
+       strcmp(mem->desc, "application") == 0 ||
+       strcmp(mem->desc, "apptable") == 0)) {
+    AVRMEM *flashmem = avr_locate_mem(p, "flash");
+    if (flashmem == NULL) {
+      pmsg_error("no flash memory region found, cannot compute bounds of %s sub-region\n", mem->desc);
+      return -1;
+    }
+    /* The config file offsets are PDI offsets, rebase to 0. */
+    low = mem->offset - flashmem->offset;
+    high = low + mem->size - 1;
+  }
+
+  // No open file means fileio() found a valid index for infile
+  if (inf) {
+    if (elf_index(infile, inf, p) < 0)
+      return -1;
+  } else
+    pmsg_notice2("reusing section index of ELF file %s\n", infile);
+
+  for (int i = 0; i < elfidx.nsect; i++) {
+    Elfsect *es = elfidx.sect + i;
+    const char *sname = es->name;
+    unsigned int lma = es->lma;
+
+    if(!(lma >= low && lma + es->size < high)) {
+      imsg_notice2("skipping %s (inappropriate for %s)\n", sname, mem->desc);
+      continue;
+    }
+    /*
+     * 1-byte sized memory regions are special: they are used for fuse
+     * bits, where multiple regions (in the config file) map to a
+     * single, larger region in the ELF file (e.g. "lfuse", "hfuse",
+     * and "efuse" all map to ".fuse").  We silently accept a larger
+     * ELF file region for these, and extract the actual byte to write
+     * from it, using the "foff" offset obtained above.
+     */
+    if (mem->size == 1) {
+      if (foff >= es->size) {
+        pmsg_error("ELF file section does not contain byte at offset %d\n", foff);
+        rv = -1;
+      } else {
+        imsg_notice2("extracting one byte from file offset %d\n", foff);
+        mem->buf[0] = es->data[foff];
+        mem->tags[0] = TAG_ALLOCATED;
+        size = 1;
+      }
+      continue;
+    }
+
+    int idx = lma-low;
+    int end = idx + es->size;
+
+    if (es->size > (unsigned) mem->size) {
+      pmsg_error("section %s of size %u does not fit into %s of size %d\n",
+        sname, es->size, mem->desc, mem->size);
+      rv = -1;
+    } else if(idx >= 0 && idx < mem->size && end >= 0 && end <= mem->size && end-idx >= 0) {
+      if (end > size)
+        size = end;
+      imsg_debug("writing %d bytes to mem offset 0x%x\n", end-idx, idx);
+      memcpy(mem->buf + idx, es->data, end-idx);
+      memset(mem->tags + idx, TAG_ALLOCATED, end-idx);
+    } else {
+      pmsg_error("section %s [0x%04x, 0x%04x] does not fit into %s [0, 0x%04x]\n",
+        sname, idx, end-1, mem->desc, mem->size-1);
+      rv = -1;
+    }
+  }
+
   return rv<0? rv: size;
 }
 #endif  /* HAVE_LIBELF */
@@ -1117,7 +1548,7 @@ static int fileio_ihex(struct fioparms *fio,
 
   switch (fio->op) {
     case FIO_WRITE:
-      rc = b2ihex(mem->buf, size, 16, fio->fileoffset, filename, f, ffmt);
+      rc = b2ihex(mem->buf, size, 16, fio->fileoffset, filename, f, ffmt, avr_mem_ffopt(mem));
       if (rc < 0) {
         return -1;
       }
@@ -1146,7 +1577,7 @@ static int fileio_srec(struct fioparms *fio,
 
   switch (fio->op) {
     case FIO_WRITE:
-      rc = b2srec(mem->buf, size, 32, fio->fileoffset, filename, f);
+      rc = b2srec(mem->buf, size, 32, fio->fileoffset, filename, f, avr_mem_ffopt(mem));
       if (rc < 0) {
         return -1;
       }
@@ -1194,6 +1625,30 @@ static int fileio_elf(struct fioparms *fio,
 
 #endif
 
+// Append the image of the first size bytes of mem to the open file f
+int fileio_sparse_append(FILE *f, const char *filename, const AVRPART *p,
+  const AVRMEM *mem, int size) {
+
+  return b2sparse(mem, p, size, filename, f);
+}
+
+static int fileio_sparse(struct fioparms *fio,
+             const char *filename, FILE *f, const AVRMEM *mem,
+             const AVRPART *p, int size)
+{
+  switch (fio->op) {
+    case FIO_WRITE:
+      return b2sparse(mem, p, size, filename, f);
+
+    case FIO_READ:
+      return sparse2b(filename, f, mem, p, size);
+
+    default:
+      pmsg_error("invalid sparse binary image file I/O operation=%d\n", fio->op);
+      return -1;
+  }
+}
+
 static int fileio_num(struct fioparms *fio,
              const char *filename, FILE *f, const AVRMEM *mem, int size,
              FILEFMT fmt)
@@ -1244,33 +1699,43 @@ static int fileio_num(struct fioparms *fio,
       return -1;
   }
 
-  for (i = 0; i < size; i++) {
-    if (i > 0) {
-      if (putc(',', f) == EOF)
-        goto writeerr;
-    }
-    num = (unsigned int)(mem->buf[i]);
+  /*
+   * Format each of the 256 possible byte values once, then assemble
+   * the output from this table
+   */
+  char (*tab)[sizeof cbuf] = cfg_malloc(__func__, 256*sizeof *tab);
+  int tlen[256];
+
+  for (num = 0; num < 256; num++) {
     /*
      * For a base of 8 and a value < 8 to convert, don't write the
      * prefix.  The conversion will be indistinguishable from a
      * decimal one then.
      */
-    if (prefix[0] != '\0' && !(base == 8 && num < 8)) {
-      if (fputs(prefix, f) == EOF)
-        goto writeerr;
-    }
-    itoa_simple(num, cbuf, base);
-    if (fputs(cbuf, f) == EOF)
-      goto writeerr;
+    strcpy(tab[num], base == 8 && num < 8? "": prefix);
+    itoa_simple(num, tab[num] + strlen(tab[num]), base);
+    tlen[num] = strlen(tab[num]);
   }
-  if (putc('\n', f) == EOF)
-    goto writeerr;
 
-  return 0;
+  Outbuf *ob = ob_open(f);
+  char *p;
+  for (i = 0; i < size; i++) {
+    p = ob_room(ob, sizeof cbuf + 1);
+    if (i > 0)
+      *p++ = ',';
+    num = mem->buf[i];
+    memcpy(p, tab[num], tlen[num]);
+    ob_fill(ob, p + tlen[num]);
+  }
+  p = ob_room(ob, 1);
+  *p++ = '\n';
+  ob_fill(ob, p);
+  free(tab);
 
- writeerr:
-  pmsg_ext_error("unable to write to %s: %s\n", filename, strerror(errno));
-  return -1;
+  if (ob_close(ob, filename) < 0)
+    return -1;
+
+  return 0;
 }
 
 
@@ -1337,6 +1802,11 @@ int fileio_fmt_autodetect(const char * fname)
       return FMT_ELF;
     }
 
+    if (first && strcmp((char *) buf, SPARSE_MAGIC) == 0) {
+      fclose(f);
+      return FMT_SPARSE;
+    }
+
     buf[MAX_LINE_LEN-1] = 0;
     len = strlen((char *)buf);
     if (buf[len-1] == '\n')
@@ -1451,6 +1921,11 @@ int fileio(int oprwv, const char *filename, FILEFMT format,
       return -1;
     }
 
+#ifdef HAVE_LIBELF
+    if (fio.op == FIO_READ && elf_index_valid(fname, p))
+      format_detect = FMT_ELF;
+    else
+#endif
     format_detect = fileio_fmt_autodetect(fname);
     if (format_detect < 0) {
       pmsg_error("cannot determine file format for %s, specify explicitly\n", fname);
@@ -1465,7 +1940,7 @@ int fileio(int oprwv, const char *filename, FILEFMT format,
 
 #if defined(WIN32)
   /* Open Raw Binary and ELF format in binary mode on Windows.*/
-  if(format == FMT_RBIN || format == FMT_ELF)
+  if(format == FMT_RBIN || format == FMT_ELF || format == FMT_SPARSE)
   {
       if(fio.op == FIO_READ)
       {
@@ -1478,7 +1953,14 @@ int fileio(int oprwv, const char *filename, FILEFMT format,
   }
 #endif
 
-  if (format != FMT_IMM) {
+#ifdef HAVE_LIBELF
+  // Leave f NULL if an ELF file read earlier in this run can be served from its index
+  int reuse_elf = format == FMT_ELF && fio.op == FIO_READ && !using_stdio && elf_index_valid(fname, p);
+#else
+  int reuse_elf = 0;
+#endif
+
+  if (format != FMT_IMM && !reuse_elf) {
     if (!using_stdio) {
       f = fopen(fname, fio.mode);
       if (f == NULL) {
@@ -1515,6 +1997,10 @@ int fileio(int oprwv, const char *filename, FILEFMT format,
       rc = fileio_imm(&fio, fname, f, mem, size);
       break;
 
+    case FMT_SPARSE:
+      rc = fileio_sparse(&fio, fname, f, mem, p, size);
+      break;
+
     case FMT_HEX:
     case FMT_DEC:
     case FMT_OCT:
@@ -1535,7 +2021,7 @@ int fileio(int oprwv, const char *filename, FILEFMT format,
       rc = hiaddr;
   }
 
-  if (format != FMT_IMM && !using_stdio) {
+  if (format != FMT_IMM && !reuse_elf && !using_stdio) {
     fclose(f);
   }
 
@@ -77,6 +77,16 @@ struct flip1
   unsigned char security_mode_flag; /* indicates the user has already
                                      * been hinted about security
                                      * mode */
+  /* Read cache for single-byte reads and read-ahead of sequential paged
+   * loads: cache_len bytes at cache_addr of memory unit cache_unit.
+   */
+  int cache_unit;
+  uint32_t cache_addr;
+  uint32_t cache_len;
+  unsigned char *cache;
+  /* Memory unit and end address of the last paged load */
+  int next_unit;
+  uint32_t next_addr;
 };
 
 #define FLIP1(pgm) ((struct flip1 *)(pgm->cookie))
@@ -134,6 +144,9 @@ enum flip1_mem_unit {
 
 #define LONG_DFU_TIMEOUT  10000 /* 10 s for program and erase */
 
+#define FLIP1_DEFAULT_XFER_SIZE 0x400   /* without wTransferSize from the device */
+#define FLIP1_READAHEAD 0x1000          /* bytes read ahead of sequential paged loads */
+
 /* EXPORTED PROGRAMMER FUNCTION PROTOTYPES */
 
 static int flip1_open(PROGRAMMER *pgm, const char *port_spec);
@@ -164,6 +177,8 @@ static void flip1_show_info(struct flip1 *flip1);
 
 static int flip1_read_memory(const PROGRAMMER *pgm,
   enum flip1_mem_unit mem_unit, uint32_t addr, void *ptr, int size);
+static int flip1_read_cached(const PROGRAMMER *pgm, int mem_unit,
+  uint32_t addr, void *ptr, int size, uint32_t fetch_addr, int fetch);
 static int flip1_write_memory(struct dfu_dev *dfu,
   enum flip1_mem_unit mem_unit, uint32_t addr, const void *ptr, int size);
 
@@ -345,6 +360,7 @@ int flip1_chip_erase(const PROGRAMMER *pgm, const AVRPART *part) {
     FLIP1_CMD_WRITE_COMMAND, { 0, 0xff }
   };
 
+  FLIP1(pgm)->cache_len = 0;
   FLIP1(pgm)->dfu->timeout = LONG_DFU_TIMEOUT;
   cmd_result = dfu_dnload(FLIP1(pgm)->dfu, &cmd, 3);
   aux_result = dfu_getstatus(FLIP1(pgm)->dfu, &status);
@@ -393,7 +409,16 @@ int flip1_read_byte(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *me
     /* 0x01 is used for blank check when reading, 0x02 is EEPROM */
     mem_unit = 2;
 
-  return flip1_read_memory(pgm, mem_unit, addr, value, 1);
+  /* Read the whole page around addr, so neighbouring bytes come from the cache */
+  uint32_t base = addr, len = 1;
+  if (mem->page_size > 1) {
+    base = addr - addr % mem->page_size;
+    len = mem->page_size;
+    if (base + len > (uint32_t) mem->size)
+      len = mem->size - base;
+  }
+
+  return flip1_read_cached(pgm, mem_unit, addr, value, 1, base, len);
 }
 
 int flip1_write_byte(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *mem,
@@ -411,6 +436,7 @@ int flip1_write_byte(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *m
     return -1;
   }
 
+  FLIP1(pgm)->cache_len = 0;
   return flip1_write_memory(FLIP1(pgm)->dfu, mem_unit, addr, &value, 1);
 }
 
@@ -433,7 +459,22 @@ int flip1_paged_load(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *m
     /* 0x01 is used for blank check when reading, 0x02 is EEPROM */
     mem_unit = 2;
 
-  return flip1_read_memory(pgm, mem_unit, addr, mem->buf + addr, n_bytes);
+  /* A load that continues the previous one reads ahead into the cache */
+  struct flip1 *flip1 = FLIP1(pgm);
+  uint32_t fetch = n_bytes;
+  if (flip1->next_unit == (int) mem_unit && flip1->next_addr == addr && n_bytes < FLIP1_READAHEAD) {
+    fetch = FLIP1_READAHEAD;
+    if (addr + fetch > (uint32_t) mem->size)
+      fetch = mem->size - addr;
+    if (fetch < n_bytes)
+      fetch = n_bytes;
+  }
+
+  int result = flip1_read_cached(pgm, mem_unit, addr, mem->buf + addr, n_bytes, addr, fetch);
+  flip1->next_unit = mem_unit;
+  flip1->next_addr = addr + n_bytes;
+
+  return result;
 }
 
 int flip1_paged_write(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *mem,
@@ -458,6 +499,7 @@ int flip1_paged_write(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *
     exit(1);
   }
 
+  FLIP1(pgm)->cache_len = 0;
   result = flip1_write_memory(FLIP1(pgm)->dfu, mem_unit, addr,
     mem->buf + addr, n_bytes);
 
@@ -544,10 +586,14 @@ void flip1_setup(PROGRAMMER * pgm)
     pmsg_error("out of memory allocating private data structure\n");
     exit(1);
   }
+
+  FLIP1(pgm)->next_unit = FLIP1_MEM_UNIT_UNKNOWN;
 }
 
 void flip1_teardown(PROGRAMMER * pgm)
 {
+  if (pgm->cookie != NULL)
+    free(FLIP1(pgm)->cache);
   free(pgm->cookie);
   pgm->cookie = NULL;
 }
@@ -565,7 +611,7 @@ int flip1_read_memory(const PROGRAMMER *pgm,
   enum flip1_mem_unit mem_unit, uint32_t addr, void *ptr, int size)
 {
   struct dfu_dev *dfu = FLIP1(pgm)->dfu;
-  unsigned short page_addr;
+  unsigned short page_addr = 0;
   struct dfu_status status;
   int cmd_result = 0;
   int aux_result;
@@ -573,73 +619,129 @@ int flip1_read_memory(const PROGRAMMER *pgm,
     FLIP1_CMD_DISPLAY_DATA, { mem_unit }
   };
   unsigned int default_timeout = dfu->timeout;
+  int read_size, first = 1;
 
 
   pmsg_notice2("flip_read_memory(%s, 0x%04x, %d)\n", flip1_mem_unit_str(mem_unit), addr, size);
 
-  /*
-   * As this function is called once per page, no need to handle 64
-   * KiB border crossing below.
-   *
-   * Also, on AVRs, no page size is larger than 1 KiB, so no need to
-   * split the request into multiple 1 KiB chunks.
-   */
-  if (mem_unit == FLIP1_MEM_UNIT_FLASH) {
-    page_addr = addr >> 16;
-    if (flip1_set_mem_page(dfu, page_addr) < 0)
+  while (size > 0) {
+    /*
+     * Each request is limited to what the bootloader can transfer in one
+     * go and must not cross a 64 KiB border.
+     */
+    read_size = dfu->xfer_size ? dfu->xfer_size : FLIP1_DEFAULT_XFER_SIZE;
+    if (read_size > size)
+      read_size = size;
+    if (read_size > 0x10000 - (addr & 0xFFFF))
+      read_size = 0x10000 - (addr & 0xFFFF);
+
+    if (mem_unit == FLIP1_MEM_UNIT_FLASH && (first || page_addr != addr >> 16)) {
+      page_addr = addr >> 16;
+      if (flip1_set_mem_page(dfu, page_addr) < 0)
+        return -1;
+    }
+    first = 0;
+
+    cmd.args[1] = (addr >> 8) & 0xFF;
+    cmd.args[2] = addr & 0xFF;
+    cmd.args[3] = ((addr + read_size - 1) >> 8) & 0xFF;
+    cmd.args[4] = (addr + read_size - 1) & 0xFF;
+
+    dfu->timeout = LONG_DFU_TIMEOUT;
+    cmd_result = dfu_dnload(dfu, &cmd, 6);
+    dfu->timeout = default_timeout;
+    aux_result = dfu_getstatus(dfu, &status);
+
+    if (cmd_result < 0 || aux_result < 0)
       return -1;
-  }
 
-  cmd.args[1] = (addr >> 8) & 0xFF;
-  cmd.args[2] = addr & 0xFF;
-  cmd.args[3] = ((addr + size - 1) >> 8) & 0xFF;
-  cmd.args[4] = (addr + size - 1) & 0xFF;
+    if (status.bStatus != DFU_STATUS_OK)
+    {
+      pmsg_error("unable to read %u bytes of %s memory @%u: %s\n", read_size,
+        flip1_mem_unit_str(mem_unit), addr, flip1_status_str(&status));
+      if (status.bState == STATE_dfuERROR)
+        dfu_clrstatus(dfu);
+      return -1;
+    }
+
+    cmd_result = dfu_upload(dfu, (char*) ptr, read_size);
+
+    /* A complete upload leaves the status check to the end of the run */
+    if (cmd_result < 0) {
+      aux_result = dfu_getstatus(dfu, &status);
+
+      if (aux_result == 0 && status.bStatus == DFU_STATUS_ERR_WRITE) {
+        if (FLIP1(pgm)->security_mode_flag == 0) {
+          msg_error("\n");
+          pmsg_error("\n");
+          imsg_error("***********************************************************************\n");
+          imsg_error("Maybe the device is in ``security mode´´, and needs a chip erase first?\n");
+          imsg_error("***********************************************************************\n");
+          msg_error("\n");
+        }
+        FLIP1(pgm)->security_mode_flag = 1;
+      }
+
+      if (aux_result == 0 && status.bStatus != DFU_STATUS_OK)
+      {
+        pmsg_error("unable to read %u bytes of %s memory @%u: %s\n", read_size,
+          flip1_mem_unit_str(mem_unit), addr, flip1_status_str(&status));
+        if (status.bState == STATE_dfuERROR)
+          dfu_clrstatus(dfu);
+      }
+      return -1;
+    }
+
+    ptr = (char*)ptr + read_size;
+    addr += read_size;
+    size -= read_size;
+  }
 
-  dfu->timeout = LONG_DFU_TIMEOUT;
-  cmd_result = dfu_dnload(dfu, &cmd, 6);
-  dfu->timeout = default_timeout;
   aux_result = dfu_getstatus(dfu, &status);
 
-  if (cmd_result < 0 || aux_result < 0)
+  if (aux_result < 0)
     return -1;
 
   if (status.bStatus != DFU_STATUS_OK)
   {
-    pmsg_error("unable to read %u bytes of %s memory @%u: %s\n", size,
-      flip1_mem_unit_str(mem_unit), addr, flip1_status_str(&status));
+    pmsg_error("unable to read %s memory: %s\n",
+      flip1_mem_unit_str(mem_unit), flip1_status_str(&status));
     if (status.bState == STATE_dfuERROR)
       dfu_clrstatus(dfu);
     return -1;
   }
 
-  cmd_result = dfu_upload(dfu, (char*) ptr, size);
-  aux_result = dfu_getstatus(dfu, &status);
+  return 0;
+}
 
-  if (cmd_result < 0 && aux_result == 0 &&
-      status.bStatus == DFU_STATUS_ERR_WRITE) {
-    if (FLIP1(pgm)->security_mode_flag == 0) {
-      msg_error("\n");
-      pmsg_error("\n");
-      imsg_error("***********************************************************************\n");
-      imsg_error("Maybe the device is in ``security mode´´, and needs a chip erase first?\n");
-      imsg_error("***********************************************************************\n");
-      msg_error("\n");
+/* Copy size bytes at addr of mem_unit to ptr from the read cache; on a miss
+ * first read fetch bytes at fetch_addr, which must cover the request, into it.
+ */
+int flip1_read_cached(const PROGRAMMER *pgm, int mem_unit,
+  uint32_t addr, void *ptr, int size, uint32_t fetch_addr, int fetch)
+{
+  struct flip1 *flip1 = FLIP1(pgm);
+  unsigned char *cache;
+
+  if (flip1->cache_len == 0 || flip1->cache_unit != mem_unit ||
+      addr < flip1->cache_addr || addr + size > flip1->cache_addr + flip1->cache_len)
+  {
+    flip1->cache_len = 0;
+    if ((cache = realloc(flip1->cache, fetch)) == NULL) {
+      pmsg_error("out of memory\n");
+      return -1;
     }
-    FLIP1(pgm)->security_mode_flag = 1;
-  }
+    flip1->cache = cache;
 
-  if (cmd_result < 0 || aux_result < 0)
-    return -1;
+    if (flip1_read_memory(pgm, mem_unit, fetch_addr, cache, fetch) != 0)
+      return -1;
 
-  if (status.bStatus != DFU_STATUS_OK)
-  {
-    pmsg_error("unable to read %u bytes of %s memory @%u: %s\n", size,
-      flip1_mem_unit_str(mem_unit), addr, flip1_status_str(&status));
-    if (status.bState == STATE_dfuERROR)
-      dfu_clrstatus(dfu);
-    return -1;
+    flip1->cache_unit = mem_unit;
+    flip1->cache_addr = fetch_addr;
+    flip1->cache_len = fetch;
   }
 
+  memcpy(ptr, flip1->cache + (addr - flip1->cache_addr), size);
   return 0;
 }
 
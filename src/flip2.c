@@ -60,6 +60,16 @@ struct flip2
   unsigned char part_sig[3];
   unsigned char part_rev;
   unsigned char boot_ver;
+  /* Read cache for single-byte reads and read-ahead of sequential paged
+   * loads: cache_len bytes at cache_addr of memory unit cache_unit.
+   */
+  int cache_unit;
+  uint32_t cache_addr;
+  uint32_t cache_len;
+  unsigned char *cache;
+  /* Memory unit and end address of the last paged load */
+  int next_unit;
+  uint32_t next_addr;
 };
 
 #define FLIP2(pgm) ((struct flip2 *)(pgm->cookie))
@@ -100,6 +110,9 @@ struct flip2_cmd {
 #define FLIP2_SELECT_MEMORY_UNIT 0x00
 #define FLIP2_SELECT_MEMORY_PAGE 0x01
 
+#define FLIP2_DEFAULT_XFER_SIZE 0x400   /* without wTransferSize from the device */
+#define FLIP2_READAHEAD 0x1000          /* bytes read ahead of sequential paged loads */
+
 enum flip2_mem_unit {
   FLIP2_MEM_UNIT_UNKNOWN = -1,
   FLIP2_MEM_UNIT_FLASH = 0x00,
@@ -159,9 +172,11 @@ static int flip2_write_memory(struct dfu_dev *dfu,
 static int flip2_set_mem_unit(struct dfu_dev *dfu,
   enum flip2_mem_unit mem_unit);
 static int flip2_set_mem_page(struct dfu_dev *dfu, unsigned short page_addr);
-static int flip2_read_max1k(struct dfu_dev *dfu,
+static int flip2_read_cached(struct flip2 *flip2, enum flip2_mem_unit mem_unit,
+  uint32_t addr, void *ptr, int size, uint32_t fetch_addr, int fetch);
+static int flip2_read_block(struct dfu_dev *dfu,
   unsigned short offset, void *ptr, unsigned short size);
-static int flip2_write_max1k(struct dfu_dev *dfu,
+static int flip2_write_block(struct dfu_dev *dfu,
   unsigned short offset, const void *ptr, unsigned short size);
 
 static const char * flip2_status_str(const struct dfu_status *status);
@@ -351,6 +366,8 @@ int flip2_chip_erase(const PROGRAMMER *pgm, const AVRPART *part) {
     FLIP2_CMD_GROUP_EXEC, FLIP2_CMD_CHIP_ERASE, { 0xFF, 0, 0, 0 }
   };
 
+  FLIP2(pgm)->cache_len = 0;
+
   for (;;) {
     cmd_result = dfu_dnload(FLIP2(pgm)->dfu, &cmd, sizeof(cmd));
     aux_result = dfu_getstatus(FLIP2(pgm)->dfu, &status);
@@ -407,7 +424,16 @@ int flip2_read_byte(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *me
     return -1;
   }
 
-  return flip2_read_memory(FLIP2(pgm)->dfu, mem_unit, addr, value, 1);
+  /* Read the whole page around addr, so neighbouring bytes come from the cache */
+  uint32_t base = addr, len = 1;
+  if (mem->page_size > 1) {
+    base = addr - addr % mem->page_size;
+    len = mem->page_size;
+    if (base + len > (uint32_t) mem->size)
+      len = mem->size - base;
+  }
+
+  return flip2_read_cached(FLIP2(pgm), mem_unit, addr, value, 1, base, len);
 }
 
 int flip2_write_byte(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *mem,
@@ -428,6 +454,7 @@ int flip2_write_byte(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *m
     return -1;
   }
 
+  FLIP2(pgm)->cache_len = 0;
   return flip2_write_memory(FLIP2(pgm)->dfu, mem_unit, addr, &value, 1);
 }
 
@@ -456,8 +483,20 @@ int flip2_paged_load(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *m
     exit(1);
   }
 
-  result = flip2_read_memory(FLIP2(pgm)->dfu, mem_unit, addr,
-    mem->buf + addr, n_bytes);
+  /* A load that continues the previous one reads ahead into the cache */
+  struct flip2 *flip2 = FLIP2(pgm);
+  uint32_t fetch = n_bytes;
+  if (flip2->next_unit == mem_unit && flip2->next_addr == addr && n_bytes < FLIP2_READAHEAD) {
+    fetch = FLIP2_READAHEAD;
+    if (addr + fetch > (uint32_t) mem->size)
+      fetch = mem->size - addr;
+    if (fetch < n_bytes)
+      fetch = n_bytes;
+  }
+
+  result = flip2_read_cached(flip2, mem_unit, addr, mem->buf + addr, n_bytes, addr, fetch);
+  flip2->next_unit = mem_unit;
+  flip2->next_addr = addr + n_bytes;
 
   return (result == 0) ? n_bytes : -1;
 }
@@ -487,6 +526,7 @@ int flip2_paged_write(const PROGRAMMER *pgm, const AVRPART *part, const AVRMEM *
     exit(1);
   }
 
+  FLIP2(pgm)->cache_len = 0;
   result = flip2_write_memory(FLIP2(pgm)->dfu, mem_unit, addr,
     mem->buf + addr, n_bytes);
 
@@ -537,10 +577,14 @@ void flip2_setup(PROGRAMMER * pgm)
     pmsg_error("out of memory allocating private data structure\n");
     exit(1);
   }
+
+  FLIP2(pgm)->next_unit = FLIP2_MEM_UNIT_UNKNOWN;
 }
 
 void flip2_teardown(PROGRAMMER * pgm)
 {
+  if (pgm->cookie != NULL)
+    free(FLIP2(pgm)->cache);
   free(pgm->cookie);
   pgm->cookie = NULL;
 }
@@ -578,6 +622,7 @@ int flip2_read_memory(struct dfu_dev *dfu,
 {
   unsigned short prev_page_addr;
   unsigned short page_addr;
+  struct dfu_status status;
   const char * mem_name;
   int read_size;
   int result;
@@ -614,8 +659,12 @@ int flip2_read_memory(struct dfu_dev *dfu,
       }
     }
 
-    read_size = (size > 0x400) ? 0x400 : size;
-    result = flip2_read_max1k(dfu, addr & 0xFFFF, ptr, read_size);
+    read_size = dfu->xfer_size ? dfu->xfer_size : FLIP2_DEFAULT_XFER_SIZE;
+    if (read_size > size)
+      read_size = size;
+    if (read_size > 0x10000 - (addr & 0xFFFF))
+      read_size = 0x10000 - (addr & 0xFFFF);
+    result = flip2_read_block(dfu, addr & 0xFFFF, ptr, read_size);
 
     if (result != 0) {
       pmsg_error("unable to read 0x%04X bytes at 0x%04lX\n", read_size, (unsigned long) addr);
@@ -627,6 +676,18 @@ int flip2_read_memory(struct dfu_dev *dfu,
     size -= read_size;
   }
 
+  /* Blocks that uploaded completely did not check the status: do it once for the run */
+  result = dfu_getstatus(dfu, &status);
+
+  if (result != 0)
+    return -1;
+
+  if (status.bStatus != DFU_STATUS_OK) {
+    pmsg_error("DFU status %s\n", flip2_status_str(&status));
+    dfu_clrstatus(dfu);
+    return -1;
+  }
+
   return 0;
 }
 
@@ -641,6 +702,11 @@ int flip2_write_memory(struct dfu_dev *dfu,
 
   pmsg_notice2("flip_write_memory(%s, 0x%04x, %d)\n", flip2_mem_unit_str(mem_unit), addr, size);
 
+  /* The command and alignment padding take up to two packets of the transfer */
+  int max_write = FLIP2_DEFAULT_XFER_SIZE;
+  if (dfu->xfer_size > 2U * dfu->dev_desc.bMaxPacketSize0)
+    max_write = dfu->xfer_size - 2 * dfu->dev_desc.bMaxPacketSize0;
+
   result = flip2_set_mem_unit(dfu, mem_unit);
 
   if (result != 0) {
@@ -671,8 +737,10 @@ int flip2_write_memory(struct dfu_dev *dfu,
       }
     }
 
-    write_size = (size > 0x800) ? 0x800 : size;
-    result = flip2_write_max1k(dfu, addr & 0xFFFF, ptr, write_size);
+    write_size = (size > max_write) ? max_write : size;
+    if (write_size > 0x10000 - (addr & 0xFFFF))
+      write_size = 0x10000 - (addr & 0xFFFF);
+    result = flip2_write_block(dfu, addr & 0xFFFF, ptr, write_size);
 
     if (result != 0) {
       pmsg_error("unable to write 0x%04X bytes at 0x%04lX\n", write_size, (unsigned long) addr);
@@ -687,6 +755,36 @@ int flip2_write_memory(struct dfu_dev *dfu,
   return 0;
 }
 
+/* Copy size bytes at addr of mem_unit to ptr from the read cache; on a miss
+ * first read fetch bytes at fetch_addr, which must cover the request, into it.
+ */
+int flip2_read_cached(struct flip2 *flip2, enum flip2_mem_unit mem_unit,
+  uint32_t addr, void *ptr, int size, uint32_t fetch_addr, int fetch)
+{
+  unsigned char *cache;
+
+  if (flip2->cache_len == 0 || flip2->cache_unit != (int) mem_unit ||
+      addr < flip2->cache_addr || addr + size > flip2->cache_addr + flip2->cache_len)
+  {
+    flip2->cache_len = 0;
+    if ((cache = realloc(flip2->cache, fetch)) == NULL) {
+      pmsg_error("out of memory\n");
+      return -1;
+    }
+    flip2->cache = cache;
+
+    if (flip2_read_memory(flip2->dfu, mem_unit, fetch_addr, cache, fetch) != 0)
+      return -1;
+
+    flip2->cache_unit = mem_unit;
+    flip2->cache_addr = fetch_addr;
+    flip2->cache_len = fetch;
+  }
+
+  memcpy(ptr, flip2->cache + (addr - flip2->cache_addr), size);
+  return 0;
+}
+
 int flip2_set_mem_unit(struct dfu_dev *dfu, enum flip2_mem_unit mem_unit)
 {
   struct dfu_status status;
@@ -755,7 +853,7 @@ int flip2_set_mem_page(struct dfu_dev *dfu,
   return cmd_result;
 }
 
-int flip2_read_max1k(struct dfu_dev *dfu,
+int flip2_read_block(struct dfu_dev *dfu,
   unsigned short offset, void *ptr, unsigned short size)
 {
   struct dfu_status status;
@@ -774,11 +872,17 @@ int flip2_read_max1k(struct dfu_dev *dfu,
   cmd_result = dfu_dnload(dfu, &cmd, sizeof(cmd));
 
   if (cmd_result != 0)
-    goto flip2_read_max1k_status;
+    goto flip2_read_block_status;
 
   cmd_result = dfu_upload(dfu, (char*) ptr, size);
 
-flip2_read_max1k_status:
+  /* The bootloader only sends all data when the read succeeds; the caller
+   * checks the status once at the end of a run of blocks.
+   */
+  if (cmd_result == 0)
+    return 0;
+
+flip2_read_block_status:
 
   aux_result = dfu_getstatus(dfu, &status);
 
@@ -798,10 +902,10 @@ flip2_read_max1k_status:
   return cmd_result;
 }
 
-int flip2_write_max1k(struct dfu_dev *dfu,
+int flip2_write_block(struct dfu_dev *dfu,
   unsigned short offset, const void *ptr, unsigned short size)
 {
-  char buffer[64+64+0x400];
+  char *buffer;
   unsigned short data_offset;
   struct dfu_status status;
   int cmd_result = 0;
@@ -816,11 +920,6 @@ int flip2_write_max1k(struct dfu_dev *dfu,
   cmd.args[2] = ((offset+size-1) >> 8) & 0xFF;
   cmd.args[3] = ((offset+size-1) >> 0) & 0xFF;
 
-  if (size > 0x400) {
-    pmsg_error("erite block too large (%hu > 1024)\n", size);
-    return -1;
-  }
-
   /* There are some special padding requirements for writes. The first packet
    * must consist only of the FLIP2 command data, which must be padded to
    * fill out the USB packet (the packet size is given by bMaxPacketSize0 in
@@ -832,11 +931,17 @@ int flip2_write_max1k(struct dfu_dev *dfu,
   data_offset = dfu->dev_desc.bMaxPacketSize0;
   data_offset += offset % dfu->dev_desc.bMaxPacketSize0;
 
+  if ((buffer = malloc(data_offset + size)) == NULL) {
+    pmsg_error("out of memory\n");
+    return -1;
+  }
+
   memcpy(buffer, &cmd, sizeof(cmd));
   memset(buffer + sizeof(cmd), 0, data_offset - sizeof(cmd));
   memcpy(buffer + data_offset, ptr, size);
 
   cmd_result = dfu_dnload(dfu, buffer, data_offset + size);
+  free(buffer);
 
   aux_result = dfu_getstatus(dfu, &status);
 
@@ -826,9 +826,11 @@ int jtag3_command(const PROGRAMMER *pgm, unsigned char *cmd, unsigned int cmdlen
   unsigned char c;
 
   pmsg_notice2("sending %s command: ", descr);
+  trace_begin(descr, cmdlen > 1? cmd[1]: 0xff);
   jtag3_send(pgm, cmd, cmdlen);
 
   status = jtag3_recv(pgm, resp);
+  trace_end(descr, cmdlen > 1? cmd[1]: 0xff);
   if (status <= 0) {
     msg_notice2("\n");
     pmsg_notice2("%s command: timeout/error communicating with programmer (status %d)\n", descr, status);
@@ -591,6 +591,7 @@ const char * pinmask_to_str(const pinmask_t * const pinmask);
 
 extern long serial_recv_timeout;  /* ms */
 extern long serial_drain_timeout; /* ms */
+extern int serial_low_latency;     /* Tune USB-serial adapters on open (-L) */
 
 union filedescriptor
 {
@@ -674,8 +675,8 @@ extern struct serial_device usbhid_serdev;
 #define serial_open (serdev->open)
 #define serial_setparams (serdev->setparams)
 #define serial_close (serdev->close)
-#define serial_send (serdev->send)
-#define serial_recv (serdev->recv)
+#define serial_send trace_send
+#define serial_recv trace_recv
 #define serial_drain (serdev->drain)
 #define serial_set_dtr_rts (serdev->set_dtr_rts)
 
@@ -684,7 +685,7 @@ typedef struct {                // Memory cache for a subset of cached pages
   int size, page_size;          // Size of cache (flash or eeprom size) and page size
   unsigned int offset;          // Offset of flash/eeprom memory
   unsigned char *cont, *copy;   // current memory contens and device copy of it
-  unsigned char *iscached;      // iscached[i] set when page i has been loaded
+  unsigned char *iscached;      // iscached[i] set when page i has been loaded (2: from cache file)
 } AVR_Cache;
 
 /* formerly pgm.h */
@@ -931,6 +932,8 @@ int avr_mem_might_be_known(const char *str);
 #define disable_trailing_ff_removal() avr_mem_hiaddr(NULL)
 int avr_mem_hiaddr(const AVRMEM * mem);
 
+int avr_mem_ffopt(const AVRMEM *mem);
+
 int avr_chip_erase(const PROGRAMMER *pgm, const AVRPART *p);
 
 int avr_unlock(const PROGRAMMER *pgm, const AVRPART *p);
@@ -953,6 +956,14 @@ int avr_page_erase_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM
 int avr_flush_cache(const PROGRAMMER *pgm, const AVRPART *p);
 int avr_reset_cache(const PROGRAMMER *pgm, const AVRPART *p);
 
+// Page-level cache access for -U operations and persistent cache files
+int avr_read_page_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem, int addr, unsigned char *buf);
+int avr_peek_page_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem, int addr, unsigned char *buf);
+int avr_read_mem_cached(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem, const AVRPART *v);
+int avr_cache_forget(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *mem);
+int avr_cache_load(const PROGRAMMER *pgm, const AVRPART *p, const char *fname, const char *key);
+int avr_cache_save(const PROGRAMMER *pgm, const AVRPART *p, const char *fname, const char *key);
+
 #ifdef __cplusplus
 }
 #endif
@@ -971,6 +982,7 @@ typedef enum {
   FMT_BIN,
   FMT_ELF,
   FMT_IHXC,
+  FMT_SPARSE,
 } FILEFMT;
 
 struct fioparms {
@@ -996,6 +1008,9 @@ char * fileio_fmtstr(FILEFMT format);
 
 int fileio_fmt_autodetect(const char * fname);
 
+int fileio_sparse_append(FILE *f, const char *filename, const AVRPART *p,
+  const AVRMEM *mem, int size);
+
 int fileio(int oprwv, const char *filename, FILEFMT format,
       const AVRPART *p, const char *memtype, int size);
 
@@ -1017,6 +1032,8 @@ enum updateflags {
   UF_NOWRITE = 1,
   UF_AUTO_ERASE = 2,
   UF_VERIFY = 4,
+  UF_SKIP_UNCHANGED = 8,
+  UF_ERASED = 16,               // Flash has been erased in this run: compare to 0xff for -d
 };
 
 
@@ -1025,6 +1042,8 @@ typedef struct update_t {
   int    op;
   char * filename;
   int    format;
+  AVRMEM *preload;              // Input file contents read by update_dryrun() or NULL
+  int    presize;               // fileio() return value for preload
 } UPDATE;
 
 typedef struct {                // File reads for flash can exclude trailing 0xff, which are cut off
@@ -1071,6 +1090,76 @@ int update_dryrun(const AVRPART *p, UPDATE *upd);
 #endif
 
 
+/* I/O tracer, see trace.c */
+
+#define TRACE_RING  1           // trace_active bits: recording into the ring buffer
+#define TRACE_STATS 2           // Collecting statistics for the performance report
+
+enum {
+  TRACE_TX = 1,                 // Bytes sent to the programmer
+  TRACE_RX,                     // Bytes received from the programmer
+  TRACE_BEGIN,                  // Start of a command or memory operation
+  TRACE_END,                    // End of a command or memory operation
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern int trace_active;
+
+int trace_open(const char *fname, size_t ringsize);
+void trace_record(int type, int code, const void *data, size_t len);
+void trace_begin(const char *name, int code);
+void trace_end(const char *name, int code);
+int trace_send(const union filedescriptor *fd, const unsigned char *buf, size_t len);
+int trace_recv(const union filedescriptor *fd, unsigned char *buf, size_t len);
+int trace_report_open(const char *fname);
+void trace_phase(const char *name);
+void trace_page(int write, unsigned long us);
+void trace_info(const char *key, const char *val);
+int trace_close(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+/* Session API for programs that drive devices through libavrdude */
+
+typedef struct avrdude_session {
+  PROGRAMMER *pgm;              // Programmer set up by the caller with initpgm()
+  const AVRPART *p;             // Part to work on
+  char *port;                   // Port for pgm->open()
+  // Per-session copies of library globals, installed during session calls
+  int verbose, quell_progress, ovsigck;
+  FP_UpdateProgress progress;
+  struct serial_device *serdev;
+  enum updateflags flags;       // Flags for do_op(), UF_VERIFY by default
+  int is_open, init_ok;
+  struct {                      // Globals of the caller while a session call runs
+    int verbose, quell_progress, ovsigck;
+    FP_UpdateProgress progress;
+    struct serial_device *serdev;
+  } saved;
+} AVRSESSION;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+AVRSESSION *session_new(PROGRAMMER *pgm, const AVRPART *p, const char *port);
+int session_open(AVRSESSION *s);
+int session_erase(AVRSESSION *s);
+int session_update(AVRSESSION *s, UPDATE *upd);
+int session_op(AVRSESSION *s, const char *spec);
+int session_close(AVRSESSION *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+
 /* formerly pgm_type.h */
 
 /*LISTID programmer_types;*/
@@ -1117,6 +1206,8 @@ extern "C" {
 
 void *cfg_malloc(const char *funcname, size_t n);
 
+void *cfg_realloc(const char *funcname, void *p, size_t n);
+
 char *cfg_strdup(const char *funcname, const char *s);
 
 int init_config(void);
@@ -50,6 +50,7 @@
 #include "libavrdude.h"
 #include "config.h"
 #include "term.h"
+#include "server.h"
 #include "developer_opts.h"
 
 /* Get VERSION from ac_cfg.h */
@@ -174,8 +175,10 @@ static void usage(void)
     "  -c <wildcard>/<flags>      Run developer options for matched programmers\n"
     "  -A                         Disable trailing-0xff removal from file and AVR read\n"
     "  -D                         Disable auto erase for flash memory; implies -A\n"
+    "  -d                         Skip writing pages that already hold the data\n"
     "  -i <delay>                 ISP Clock Delay [in microseconds]\n"
     "  -P <port>                  Specify connection port\n"
+    "  -L                         Tune USB-serial adapters for low latency (Linux)\n"
     "  -F                         Override invalid signature or initialisation check\n"
     "  -e                         Perform a chip erase\n"
     "  -O                         Perform RC oscillator calibration (see AVR053)\n"
@@ -186,11 +189,15 @@ static void usage(void)
     "  -n                         Do not write anything to the device\n"
     "  -V                         Do not verify\n"
     "  -t                         Enter terminal mode\n"
+    "  -S <socket>                Serve memory jobs on a Unix or TCP socket\n"
     "  -E <exitspec>[,<exitspec>] List programmer exit specifications\n"
     "  -x <extended_param>        Pass <extended_param> to programmer\n"
     "  -v                         Verbose output; -v -v for more\n"
     "  -q                         Quell progress output; -q -q for less\n"
     "  -l logfile                 Use logfile rather than stderr for diagnostics\n"
+    "  -k <cachefile>             Keep device contents in <cachefile> across runs; implies -d\n"
+    "  -R <tracefile>             Record programmer I/O and write it to <tracefile> on exit\n"
+    "  -T <reportfile>            Write per-phase timing and I/O statistics as JSON on exit\n"
     "  -?                         Display this usage\n"
     "\navrdude version %s, URL: <https://github.com/mariusgreuel/avrdude>\n",
     progname, version);
@@ -387,6 +394,7 @@ static void cleanup_main(void)
     }
 
     cleanup_config();
+    trace_close();
 }
 
 static void replace_backslashes(char *s)
@@ -483,6 +491,9 @@ int main(int argc, char * argv [])
   int     calibrate;   /* 1=calibrate RC oscillator, 0=don't */
   char  * port;        /* device port (/dev/xxx) */
   int     terminal;    /* 1=enter terminal mode, 0=don't */
+  const char *server;  /* socket for server mode, NULL if none */
+  const char *tracefile; /* file for the programmer I/O trace, NULL if none */
+  const char *reportfile; /* file for the JSON performance report, NULL if none */
   const char *exitspecs; /* exit specs string from command line */
   const char *programmer; /* programmer id */
   char    sys_config[PATH_MAX]; /* system wide config file */
@@ -499,7 +510,10 @@ int main(int argc, char * argv [])
   int     is_open;     /* Device open succeeded */
   int     ce_delayed;  /* Chip erase delayed */
   char  * logfile;     /* Use logfile rather than stderr for diagnostics */
+  char  * cachefile;   /* Persistent flash/EEPROM cache file */
+  char    cachekey[1024]; /* Identifies programmer, port and device in cachefile */
   enum updateflags uflags = UF_AUTO_ERASE | UF_VERIFY; /* Flags for do_op() */
+  enum updateflags sflags;     /* Flags for server mode jobs */
 
   (void) avr_ustimestamp();
 
@@ -570,6 +584,9 @@ int main(int argc, char * argv [])
   p             = NULL;
   ovsigck       = 0;
   terminal      = 0;
+  server        = NULL;
+  tracefile     = NULL;
+  reportfile    = NULL;
   quell_progress = 0;
   exitspecs     = NULL;
   pgm           = NULL;
@@ -581,6 +598,8 @@ int main(int argc, char * argv [])
   is_open       = 0;
   ce_delayed    = 0;
   logfile       = NULL;
+  cachefile     = NULL;
+  cachekey[0]   = 0;
 
   len = strlen(progname) + 2;
   for (i=0; i<len; i++)
@@ -599,7 +618,7 @@ int main(int argc, char * argv [])
   /*
    * process command line arguments
    */
-  while ((ch = getopt(argc,argv,"?Ab:B:c:C:DeE:Fi:l:np:OP:qstU:uvVx:yY:")) != -1) {
+  while ((ch = getopt(argc,argv,"?Ab:B:c:C:dDeE:Fi:k:l:Lnp:OP:qR:sS:tT:U:uvVx:yY:")) != -1) {
 
     switch (ch) {
       case 'b': /* override default programmer baud rate */
@@ -679,6 +698,10 @@ int main(int argc, char * argv [])
         }
         break;
 
+      case 'd': /* differential write: skip pages that already hold the data */
+        uflags |= UF_SKIP_UNCHANGED;
+        break;
+
       case 'D': /* disable auto erase */
         uflags &= ~UF_AUTO_ERASE;
         /* fall through */
@@ -700,6 +723,11 @@ int main(int argc, char * argv [])
         ovsigck = 1;
         break;
 
+      case 'k': /* persistent cache file, implies differential write */
+        cachefile = optarg;
+        uflags |= UF_SKIP_UNCHANGED;
+        break;
+
       case 'l':
 	logfile = optarg;
 	break;
@@ -728,6 +756,22 @@ int main(int argc, char * argv [])
         terminal = 1;
         break;
 
+      case 'L': /* low-latency tuning of USB-serial adapters */
+        serial_low_latency = 1;
+        break;
+
+      case 'R': /* record programmer I/O trace */
+        tracefile = optarg;
+        break;
+
+      case 'T': /* write performance report */
+        reportfile = optarg;
+        break;
+
+      case 'S': /* serve memory jobs on a socket */
+        server = optarg;
+        break;
+
       case 's':
       case 'u':
         pmsg_error("\"safemode\" feature no longer supported\n");
@@ -785,6 +829,14 @@ int main(int argc, char * argv [])
     }
   }
 
+  if (tracefile != NULL)
+    trace_open(tracefile, 4*1024*1024);
+  if (reportfile != NULL) {
+    trace_report_open(reportfile);
+    trace_info("version", version);
+    trace_phase("config");
+  }
+
   /* search for system configuration file unless -C conffile was given */
   if (strlen(sys_config) == 0) {
     /*
@@ -1090,45 +1142,6 @@ int main(int argc, char * argv [])
     }
   }
 
-  /*
-   * open the programmer
-   */
-  if (port[0] == 0) {
-    msg_error("\n");
-    pmsg_error("no port has been specified on the command line or in the config file\n");
-    imsg_error("specify a port using the -P option and try again\n\n");
-    exit(1);
-  }
-
-  if (verbose) {
-    imsg_notice("Using Port                    : %s\n", port);
-    imsg_notice("Using Programmer              : %s\n", programmer);
-  }
-
-  if (baudrate != 0) {
-    imsg_notice("Overriding Baud Rate          : %d\n", baudrate);
-    pgm->baudrate = baudrate;
-  }
-
-  if (bitclock != 0.0) {
-    imsg_notice("Setting bit clk period        : %.1f\n", bitclock);
-    pgm->bitclock = bitclock * 1e-6;
-  }
-
-  if (ispdelay != 0) {
-    imsg_notice("Setting isp clock delay        : %3i\n", ispdelay);
-    pgm->ispdelay = ispdelay;
-  }
-
-  rc = pgm->open(pgm, port);
-  if (rc < 0) {
-    pmsg_error("unable to open programmer %s on port %s\n", programmer, port);
-    exitrc = 1;
-    pgm->ppidata = 0; /* clear all bits at exit */
-    goto main_exit;
-  }
-  is_open = 1;
-
   if (partdesc == NULL) {
     part_not_found(NULL);
     exitrc = 1;
@@ -1142,18 +1155,6 @@ int main(int argc, char * argv [])
     goto main_exit;
   }
 
-  if (exitspecs != NULL) {
-    if (pgm->parseexitspecs == NULL) {
-      pmsg_warning("-E option not supported by this programmer type\n");
-      exitspecs = NULL;
-    }
-    else if (pgm->parseexitspecs(pgm, exitspecs) < 0) {
-      usage();
-      exitrc = 1;
-      goto main_exit;
-    }
-  }
-
   if (avr_initmem(p) != 0) {
     msg_error("\n");
     pmsg_error("unable to initialize memories\n");
@@ -1176,8 +1177,14 @@ int main(int argc, char * argv [])
    * options using the default memory region, fill in the device-dependent
    * default region name ("application" for Xmega parts or "flash" otherwise)
    * and check for basic problems with memory names or file access with a
-   * view to exit before programming.
+   * view to exit before programming. Input files of write and verify
+   * operations are read here, too, so that file errors surface before
+   * the programmer is opened, and the time for opening the programmer
+   * and initialising the device is not added to by parsing files.
    */
+  trace_info("programmer", (char *) ldata(lfirst(pgm->id)));
+  trace_info("part", p->id);
+  trace_phase("file parse");
   int doexit = 0;
   for (ln=lfirst(updates); ln; ln=lnext(ln)) {
     upd = ldata(ln);
@@ -1198,6 +1205,59 @@ int main(int argc, char * argv [])
     goto main_exit;
   }
 
+  /*
+   * open the programmer
+   */
+  if (port[0] == 0) {
+    msg_error("\n");
+    pmsg_error("no port has been specified on the command line or in the config file\n");
+    imsg_error("specify a port using the -P option and try again\n\n");
+    exit(1);
+  }
+
+  if (verbose) {
+    imsg_notice("Using Port                    : %s\n", port);
+    imsg_notice("Using Programmer              : %s\n", programmer);
+  }
+
+  if (baudrate != 0) {
+    imsg_notice("Overriding Baud Rate          : %d\n", baudrate);
+    pgm->baudrate = baudrate;
+  }
+
+  if (bitclock != 0.0) {
+    imsg_notice("Setting bit clk period        : %.1f\n", bitclock);
+    pgm->bitclock = bitclock * 1e-6;
+  }
+
+  if (ispdelay != 0) {
+    imsg_notice("Setting isp clock delay        : %3i\n", ispdelay);
+    pgm->ispdelay = ispdelay;
+  }
+
+  trace_info("port", port);
+  trace_phase("open");
+  rc = pgm->open(pgm, port);
+  if (rc < 0) {
+    pmsg_error("unable to open programmer %s on port %s\n", programmer, port);
+    exitrc = 1;
+    pgm->ppidata = 0; /* clear all bits at exit */
+    goto main_exit;
+  }
+  is_open = 1;
+
+  if (exitspecs != NULL) {
+    if (pgm->parseexitspecs == NULL) {
+      pmsg_warning("-E option not supported by this programmer type\n");
+      exitspecs = NULL;
+    }
+    else if (pgm->parseexitspecs(pgm, exitspecs) < 0) {
+      usage();
+      exitrc = 1;
+      goto main_exit;
+    }
+  }
+
   if (calibrate) {
     /*
      * perform an RC oscillator calibration
@@ -1241,6 +1301,7 @@ int main(int argc, char * argv [])
   /*
    * initialize the chip in preparation for accepting commands
    */
+  trace_phase("initialize");
   init_ok = (rc = pgm->initialize(pgm, p)) >= 0;
   if (!init_ok) {
     pmsg_error("initialization failed, rc=%d\n", rc);
@@ -1267,6 +1328,7 @@ int main(int argc, char * argv [])
    * against 0xffffff / 0x000000 should ensure that the signature bytes
    * are valid.
    */
+  trace_phase("signature");
   if(!(p->prog_modes & PM_aWire)) { // not AVR32
     int attempt = 0;
     int waittime = 10000;       /* 10 ms */
@@ -1374,6 +1436,7 @@ int main(int argc, char * argv [])
     }
   }
 
+  sflags = uflags;              // Server jobs apply the auto-erase rule per client
   if (uflags & UF_AUTO_ERASE) {
     if ((p->prog_modes & PM_PDI) && pgm->page_erase && lsize(updates) > 0) {
       pmsg_info("Note: programmer supports page erase for Xmega devices.\n");
@@ -1400,6 +1463,7 @@ int main(int argc, char * argv [])
   }
 
   if (init_ok && erase) {
+    trace_phase("erase");
     /*
      * erase the chip's flash and eeprom memories, this is required
      * before the chip can accept new programming
@@ -1415,14 +1479,42 @@ int main(int argc, char * argv [])
         exitrc = 0;
       } else if(exitrc)
         goto main_exit;
+      uflags |= UF_ERASED;      // No need for -d to read back erased flash
     }
   }
 
+  if (init_ok && cachefile) {
+    /*
+     * Key the cache file by programmer, port, part signature and, if available,
+     * serial number; after a chip erase the cached contents are obsolete
+     */
+    AVRMEM *m;
+    char *q = cachekey, *end = cachekey + sizeof cachekey;
+
+    // Hex bytes go last and need at most 2*(8+64)+2 bytes, so truncate names and port early
+    snprintf(q, end - q - 160, "%s %s %s", (char *) ldata(lfirst(pgm->id)), port, p->id);
+    q += strlen(q);
+    if ((m = avr_locate_mem(p, "signature")))
+      for (i=0; i<m->size && i<8; i++)
+        q += snprintf(q, end - q, "%s%02x", i? "": " ", m->buf[i]);
+    if ((m = avr_locate_mem(p, "sernum")) && avr_read(pgm, p, "sernum", NULL) >= 0)
+      for (i=0; i<m->size && i<64; i++)
+        q += snprintf(q, end - q, "%s%02x", i? "": " ", m->buf[i]);
+
+    trace_phase("cache");
+    if (erase || (uflags & UF_NOWRITE))
+      pmsg_notice("not using cache file %s\n", cachefile);
+    else if ((rc = avr_cache_load(pgm, p, cachefile, cachekey)) > 0)
+      pmsg_info("loaded %d page%s of device contents from cache file %s\n",
+        rc, update_plural(rc), cachefile);
+  }
+
   if (terminal) {
     /*
      * terminal mode
      */
     exitrc = terminal_mode(pgm, p);
+    uflags &= ~UF_ERASED;       // Terminal might have written to flash
   }
 
   if (!init_ok) {
@@ -1442,6 +1534,24 @@ int main(int argc, char * argv [])
       break;
     } else if(rc == 0 && upd->op == DEVICE_WRITE && avr_memtype_is_flash_type(upd->memtype))
       ce_delayed = 0;           // Redeemed chip erase promise
+    if (upd->op == DEVICE_WRITE && avr_memtype_is_flash_type(upd->memtype))
+      uflags &= ~UF_ERASED;     // Flash no longer blank
+  }
+
+  if (server && exitrc == 0) {
+    trace_phase("serve");
+    exitrc = server_mode(pgm, p, server, sflags);
+    ce_delayed = 0;           // Clients take care of the flash contents
+  }
+
+  if (*cachekey && !(uflags & UF_NOWRITE)) {
+    trace_phase("cache");
+    // Only keep the cache if all went well, otherwise have the next run start afresh
+    if (exitrc == 0) {
+      if (avr_cache_save(pgm, p, cachefile, cachekey) < 0)
+        exitrc = 1;
+    } else
+      unlink(cachefile);
   }
 
 main_exit:
@@ -1449,6 +1559,7 @@ main_exit:
   /*
    * program complete
    */
+  trace_phase("close");
 
   if (is_open) {
     pgm->powerdown(pgm);
@@ -1462,5 +1573,7 @@ main_exit:
 
   msg_info("\n%s done.  Thank you.\n\n", progname);
 
-  return ce_delayed? 1: exitrc;
+  exitrc = ce_delayed? 1: exitrc;
+  trace_info("exit_code", exitrc? "1": "0");
+  return exitrc;
 }
@@ -102,6 +102,7 @@ typedef struct pdata
     uint16_t user_reset_vector; // reset vector of user program
     bool write_last_page;       // last page already programmed
     bool start_program;         // require start after flash
+    bool erased;                // flash erased, so blank pages need not be written
 } pdata_t;
 
 //-----------------------------------------------------------------------------
@@ -348,6 +349,8 @@ static int micronucleus_erase_device(pdata_t* pdata)
         }
     }
 
+    pdata->erased = true;
+
     return 0;
 }
 
@@ -470,10 +473,32 @@ static int micronucleus_write_page_v2(pdata_t* pdata, uint32_t address, uint8_t*
     return 0;
 }
 
+static bool micronucleus_is_blank(const uint8_t* buffer, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (buffer[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static int micronucleus_write_page(pdata_t* pdata, uint32_t address, uint8_t* buffer, uint32_t size)
 {
     pmsg_debug("micronucleus_write_page(address=0x%04X, size=%d)\n", address, size);
 
+    // An erased page already reads 0xFF: skip the transfer and the write delay.
+    // The first and last page get patched vectors and are always written.
+    if (pdata->erased && address != 0 && address < pdata->bootloader_start - pdata->page_size &&
+        micronucleus_is_blank(buffer, size))
+    {
+        pmsg_debug("skipping blank page at 0x%04X\n", address);
+        return 0;
+    }
+
     if (address == 0)
     {
         if (pdata->major_version >= 2)
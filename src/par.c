@@ -156,6 +156,91 @@ static int par_getpin(const PROGRAMMER * pgm, int pinfunc) {
 }
 
 
+/*
+ * Register and bit of an output pin, which may carry PIN_INVERSE, and
+ * whether it is inverted overall; returns -1 if it is not an output pin
+ */
+static int par_outbit(int pin, int *reg, int *bit, int *inverted) {
+  *inverted = !!(pin & PIN_INVERSE);
+  pin &= PIN_MASK;
+
+  if (pin < 1 || pin > 17)
+    return -1;
+
+  pin--;
+  if (ppipins[pin].reg == PPISTATUS)
+    return -1;
+
+  *reg = ppipins[pin].reg;
+  *bit = ppipins[pin].bit;
+  if (ppipins[pin].inverted)
+    *inverted = !*inverted;
+
+  return 0;
+}
+
+/*
+ * Transmit an AVR command when SDO and SCK share a port register: the port
+ * values for all 16 SCK phases of a byte are computed up front, and the
+ * falling SCK edge of each bit goes out with SDO of the next bit in one
+ * register write. A bit then costs two writes and one status read instead
+ * of up to three writes and one read; SDO only changes whilst SCK is low.
+ */
+static int par_cmd(const PROGRAMMER *pgm, const unsigned char *cmd, unsigned char *res) {
+  int reg, sdobit, sdoinv, sckreg, sckbit, sckinv, port;
+  unsigned char seq[16];
+
+  if (par_outbit(pgm->pinno[PIN_AVR_SDO], &reg, &sdobit, &sdoinv) < 0 ||
+      par_outbit(pgm->pinno[PIN_AVR_SCK], &sckreg, &sckbit, &sckinv) < 0 || sckreg != reg)
+    return bitbang_cmd(pgm, cmd, res);
+
+  if ((port = ppi_getall(&pgm->fd, reg)) < 0)
+    return -1;
+
+  for (int i = 0; i < 4; i++) {
+    unsigned char rbyte = 0, r;
+
+    for (int b = 0; b < 8; b++) {
+      int sdo = (cmd[i] >> (7-b)) & 1;
+
+      seq[2*b] = (port & ~(sdobit | sckbit)) | (sdo != sdoinv? sdobit: 0) | (sckinv? sckbit: 0);
+      seq[2*b+1] = seq[2*b] ^ sckbit;
+    }
+
+    for (int b = 0; b < 8; b++) {
+      if (seq[2*b] != port)
+        ppi_setall(&pgm->fd, reg, seq[2*b]);
+      if (pgm->ispdelay > 1)
+        bitbang_delay(pgm->ispdelay);
+
+      ppi_setall(&pgm->fd, reg, port = seq[2*b+1]);
+      if (pgm->ispdelay > 1)
+        bitbang_delay(pgm->ispdelay);
+
+      r = par_getpin(pgm, PIN_AVR_SDI);
+      rbyte |= r << (7-b);
+    }
+    res[i] = rbyte;
+  }
+
+  ppi_setall(&pgm->fd, reg, port ^= sckbit);
+  if (pgm->ispdelay > 1)
+    bitbang_delay(pgm->ispdelay);
+
+  if (verbose >= 2) {
+    msg_notice2("par_cmd(): [ ");
+    for (int i = 0; i < 4; i++)
+      msg_notice2("%02X ", cmd[i]);
+    msg_notice2("] [ ");
+    for (int i = 0; i < 4; i++)
+      msg_notice2("%02X ", res[i]);
+    msg_notice2("]\n");
+  }
+
+  return 0;
+}
+
+
 static int par_highpulsepin(const PROGRAMMER *pgm, int pinfunc) {
   int inverted, pin;
 
@@ -388,7 +473,7 @@ void par_initpgm(PROGRAMMER *pgm) {
   pgm->powerdown      = par_powerdown;
   pgm->program_enable = bitbang_program_enable;
   pgm->chip_erase     = bitbang_chip_erase;
-  pgm->cmd            = bitbang_cmd;
+  pgm->cmd            = par_cmd;
   pgm->cmd_tpi        = bitbang_cmd_tpi;
   pgm->spi            = bitbang_spi;
   pgm->open           = par_open;
@@ -90,13 +90,16 @@ static int ppi_shadow_access(const union filedescriptor *fdp, int reg,
 }
 
 /*
- * set the indicated bit of the specified register.
+ * set the indicated bit of the specified register; as the shadow
+ * register holds the port contents, no write is needed if it is set
  */
 int ppi_set(const union filedescriptor *fdp, int reg, int bit) {
   unsigned char v;
   int rc;
 
   rc = ppi_shadow_access(fdp, reg, &v, PPI_SHADOWREAD);
+  if (!rc && (v & bit) == bit)
+    return 0;
   v |= bit;
   rc |= ppi_shadow_access(fdp, reg, &v, PPI_WRITE);
 
@@ -108,13 +111,16 @@ int ppi_set(const union filedescriptor *fdp, int reg, int bit) {
 
 
 /*
- * clear the indicated bit of the specified register.
+ * clear the indicated bit of the specified register; no write is needed
+ * if it is already clear
  */
 int ppi_clr(const union filedescriptor *fdp, int reg, int bit) {
   unsigned char v;
   int rc;
 
   rc = ppi_shadow_access(fdp, reg, &v, PPI_SHADOWREAD);
+  if (!rc && !(v & bit))
+    return 0;
   v &= ~bit;
   rc |= ppi_shadow_access(fdp, reg, &v, PPI_WRITE);
 
@@ -38,12 +38,19 @@
 #include <sys/time.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h>
 
 #include <fcntl.h>
+#include <limits.h>
 #include <termios.h>
 #include <unistd.h>
 
+#ifdef __linux__
+# include <linux/serial.h>
+#endif
+
 #ifdef __APPLE__
 # include <IOKit/serial/ioss.h>
 #endif
@@ -53,6 +60,210 @@
 
 long serial_recv_timeout = 5000; /* ms */
 long serial_drain_timeout = 250; /* ms */
+int serial_low_latency;          /* Tune USB-serial adapters on open (-L) */
+
+/*
+ * Low-latency tuning of USB-serial adapters (-L, Linux only). FTDI chips
+ * hold back received bytes until their latency timer expires (16 ms by
+ * default) unless their buffer fills, which dominates the stop-and-wait
+ * protocols of bootloaders. For FTDI, CH34x and CP210x adapters the port
+ * is switched to ASYNC_LOW_LATENCY and, for FTDI, the latency timer is
+ * set to 1 ms where permissions allow; ser_close() restores both and
+ * reports how many response turnarounds ran with the shorter timer.
+ */
+static struct {
+  int fd;                       // Tuned port, -1 if none
+  char *latency_path;           // sysfs latency_timer file of an FTDI adapter
+  int latency;                  // Original latency timer in ms, -1 if unchanged
+  int serial_flags;             // Original serial_struct flags, -1 if unchanged
+  int sent;                     // Bytes were sent since the last receive
+  unsigned long turnarounds;    // Receives that followed a send whilst tuned
+} tune = { .fd = -1, .latency = -1, .serial_flags = -1 };
+
+/*
+ * State of a network connection (-P net:host:port or rfc2217:host:port).
+ * Each ser_send() goes out immediately, as programmers rely on the timing
+ * of their writes, eg, when they pause between wake-up sequences; wbuf
+ * only assembles telnet escapes and option negotiations into one write.
+ * With RFC 2217 the stream is a telnet session: payload 0xff
+ * bytes are doubled and telnet commands from the server are filtered
+ * out of the received data by a small state machine (iacstate).
+ */
+#define NET_WBUFSIZE 4096
+
+static struct {
+  int fd;                       // Socket of the connection, -1 if none
+  int rfc2217;                  // Telnet COM-PORT-OPTION (RFC 2217) in use
+  int iacstate;                 // Telnet receive parser state
+  unsigned char iaccmd;         // Pending WILL/WONT/DO/DONT command
+  size_t wlen;                  // Bytes in wbuf not yet sent
+  unsigned char wbuf[NET_WBUFSIZE];
+} net = { .fd = -1 };
+
+// Telnet (RFC 854) and RFC 2217 codes
+#define TN_IAC              255
+#define TN_DONT             254
+#define TN_DO               253
+#define TN_WONT             252
+#define TN_WILL             251
+#define TN_SB               250
+#define TN_SE               240
+#define TN_BINARY             0
+#define TN_SGA                3
+#define TN_COMPORT           44
+#define CPO_SET_BAUDRATE      1
+#define CPO_SET_DATASIZE      2
+#define CPO_SET_PARITY        3
+#define CPO_SET_STOPSIZE      4
+#define CPO_SET_CONTROL       5
+#define CPO_DTR_ON            8
+#define CPO_DTR_OFF           9
+#define CPO_RTS_ON           11
+#define CPO_RTS_OFF          12
+
+static int is_net(const union filedescriptor *fd) {
+  return net.fd >= 0 && fd->ifd == net.fd;
+}
+
+// Write len raw bytes to the socket
+static int net_write(const unsigned char *p, size_t len) {
+  while (len) {
+    ssize_t rc = write(net.fd, p, len);
+    if (rc < 0) {
+      if (errno == EINTR)
+        continue;
+      pmsg_ext_error("unable to write: %s\n", strerror(errno));
+      return -1;
+    }
+    p += rc;
+    len -= rc;
+  }
+  return 0;
+}
+
+// Send out collected writes
+static int net_flush(void) {
+  int rc = 0;
+
+  if (net.wlen)
+    rc = net_write(net.wbuf, net.wlen);
+  net.wlen = 0;
+  return rc;
+}
+
+// Queue len bytes for sending; double telnet IAC bytes unless raw is set
+static int net_queue(const unsigned char *p, size_t len, int raw) {
+  for (; len; p++, len--) {
+    if (net.wlen + 2 > sizeof net.wbuf && net_flush() < 0)
+      return -1;
+    net.wbuf[net.wlen++] = *p;
+    if (net.rfc2217 && !raw && *p == TN_IAC)
+      net.wbuf[net.wlen++] = TN_IAC;
+  }
+  return 0;
+}
+
+/*
+ * Remove telnet commands from n received bytes in buf and answer option
+ * requests from the server that were not offered. Returns the number of
+ * payload bytes left at the start of buf.
+ */
+static size_t net_filter(unsigned char *buf, size_t n) {
+  unsigned char *q = buf, reply[3];
+
+  for (size_t i = 0; i < n; i++) {
+    unsigned char c = buf[i];
+
+    switch (net.iacstate) {
+    case 0:                     // Data
+      if (c == TN_IAC)
+        net.iacstate = 1;
+      else
+        *q++ = c;
+      break;
+    case 1:                     // After IAC
+      net.iacstate = 0;
+      if (c == TN_IAC)
+        *q++ = c;
+      else if (c >= TN_WILL && c <= TN_DONT)
+        net.iaccmd = c, net.iacstate = 2;
+      else if (c == TN_SB)
+        net.iacstate = 3;
+      break;
+    case 2:                     // Option of WILL/WONT/DO/DONT
+      net.iacstate = 0;
+      if ((net.iaccmd == TN_DO && c != TN_BINARY && c != TN_SGA && c != TN_COMPORT) ||
+          (net.iaccmd == TN_WILL && c != TN_BINARY && c != TN_SGA)) {
+        reply[0] = TN_IAC;
+        reply[1] = net.iaccmd == TN_DO? TN_WONT: TN_DONT;
+        reply[2] = c;
+        net_queue(reply, 3, 1);
+      }
+      break;
+    case 3:                     // Subnegotiation, eg, RFC 2217 notifications: ignored
+      if (c == TN_IAC)
+        net.iacstate = 4;
+      break;
+    case 4:                     // IAC within subnegotiation
+      net.iacstate = c == TN_SE? 0: 3;
+      break;
+    }
+  }
+
+  return q - buf;
+}
+
+// Send an RFC 2217 COM-PORT-OPTION subnegotiation with a value of len bytes
+static int net_comport(int cmd, unsigned long val, int len) {
+  unsigned char sb[] = { TN_IAC, TN_SB, TN_COMPORT, cmd }, se[] = { TN_IAC, TN_SE }, v[4];
+
+  for (int i = 0; i < len; i++)
+    v[i] = val >> 8*(len-1-i);
+
+  if (net_queue(sb, sizeof sb, 1) < 0 || net_queue(v, len, 0) < 0 || net_queue(se, sizeof se, 1) < 0)
+    return -1;
+  return 0;
+}
+
+// Set baud rate and frame format of the remote serial port via RFC 2217
+static int net_setparams(long baud, unsigned long cflags) {
+  int datasize = (cflags & SERIAL_CS8)? 8: (cflags & SERIAL_CS7)? 7: (cflags & SERIAL_CS6)? 6: 5;
+  int parity = !(cflags & SERIAL_PARENB)? 1: (cflags & SERIAL_PARODD)? 2: 3;
+  int stopsize = (cflags & SERIAL_CSTOPB)? 2: 1;
+
+  if (net_comport(CPO_SET_BAUDRATE, baud, 4) < 0 || net_comport(CPO_SET_DATASIZE, datasize, 1) < 0 ||
+      net_comport(CPO_SET_PARITY, parity, 1) < 0 || net_comport(CPO_SET_STOPSIZE, stopsize, 1) < 0)
+    return -EIO;
+
+  return net_flush() < 0? -EIO: 0;
+}
+
+// Switch off Nagle's algorithm and delayed ACKs, detect dead peers
+static void net_tune(int fd) {
+  int one = 1;
+
+  if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one) < 0)
+    pmsg_notice("cannot set TCP_NODELAY: %s\n", strerror(errno));
+#ifdef TCP_QUICKACK
+  setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof one);
+#endif
+  if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof one) < 0)
+    pmsg_notice("cannot set SO_KEEPALIVE: %s\n", strerror(errno));
+#ifdef TCP_KEEPIDLE
+  int idle = 10, intvl = 5, cnt = 3;
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof idle);
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof intvl);
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof cnt);
+#endif
+}
+
+// Linux falls back to delayed ACKs after a while; re-arm after reads
+static void net_quickack(void) {
+#ifdef TCP_QUICKACK
+  int one = 1;
+  setsockopt(net.fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof one);
+#endif
+}
 
 struct baud_mapping {
   long baud;
@@ -150,8 +361,13 @@ static int ser_setparams(const union filedescriptor *fd, long baud, unsigned lon
   int rc;
   struct termios termios;
   bool nonstandard;
-  speed_t speed = serial_baud_lookup (baud, &nonstandard);
-  
+  speed_t speed;
+
+  if (is_net(fd) && net.rfc2217)
+    return net_setparams(baud, cflags);
+
+  speed = serial_baud_lookup (baud, &nonstandard);
+
   if (!isatty(fd->ifd))
     return -ENOTTY;
   
@@ -342,7 +558,9 @@ static int net_open(const char *port, union filedescriptor *fdp) {
     pmsg_ext_error("cannot connect: %s\n", strerror(errno));
   }
   else {
-    fdp->ifd = fd;
+    net_tune(fd);
+    memset(&net, 0, sizeof net);
+    net.fd = fdp->ifd = fd;
     ret = 0;
   }
   freeaddrinfo(result);
@@ -353,10 +571,44 @@ error:
 }
 
 
+/*
+ * Open a network connection to an RFC 2217 server (eg, ser2net with the
+ * telnet(rfc2217) option) and set up its serial port: unlike plain net:
+ * connections, baud rate and DTR/RTS can be controlled remotely.
+ */
+static int rfc2217_open(const char *port, long baud, unsigned long cflags, union filedescriptor *fdp) {
+  static const unsigned char nego[] = {
+    TN_IAC, TN_WILL, TN_BINARY, TN_IAC, TN_DO, TN_BINARY,
+    TN_IAC, TN_WILL, TN_SGA, TN_IAC, TN_DO, TN_SGA,
+    TN_IAC, TN_WILL, TN_COMPORT,
+  };
+
+  if (net_open(port, fdp) < 0)
+    return -1;
+  net.rfc2217 = 1;
+  if (net_queue(nego, sizeof nego, 1) < 0 || net_flush() < 0 || (baud > 0 && net_setparams(baud, cflags) < 0)) {
+    close(fdp->ifd);
+    net.fd = -1;
+    return -1;
+  }
+
+  return 0;
+}
+
+
 static int ser_set_dtr_rts(const union filedescriptor *fdp, int is_on) {
   unsigned int	ctl;
   int           r;
 
+  if (is_net(fdp)) {            // Plain net: connections have no modem control lines
+    if (!net.rfc2217)
+      return 0;
+    if (net_comport(CPO_SET_CONTROL, is_on? CPO_DTR_ON: CPO_DTR_OFF, 1) < 0 ||
+        net_comport(CPO_SET_CONTROL, is_on? CPO_RTS_ON: CPO_RTS_OFF, 1) < 0 || net_flush() < 0)
+      return -1;
+    return 0;
+  }
+
   r = ioctl(fdp->ifd, TIOCMGET, &ctl);
   if (r < 0) {
     pmsg_ext_error("ioctl(\"TIOCMGET\"): %s\n", strerror(errno));
@@ -381,6 +633,121 @@ static int ser_set_dtr_rts(const union filedescriptor *fdp, int is_on) {
   return 0;
 }
 
+#ifdef __linux__
+static int sysfs_read_int(const char *path, int *val) {
+  FILE *f = fopen(path, "r");
+  int ok;
+
+  if(!f)
+    return -1;
+  ok = fscanf(f, "%d", val) == 1;
+  fclose(f);
+
+  return ok? 0: -1;
+}
+
+static int sysfs_write_int(const char *path, int val) {
+  FILE *f = fopen(path, "w");
+  int ok;
+
+  if(!f)
+    return -1;
+  ok = fprintf(f, "%d\n", val) > 0;
+  if(fclose(f) != 0)
+    ok = 0;
+
+  return ok? 0: -1;
+}
+
+static void ser_tune(const char *port, int fd) {
+  char *dev, *tty, path[PATH_MAX], link[PATH_MAX], *driver;
+  struct serial_struct ss;
+  ssize_t n;
+  int lat;
+
+  if(!(dev = realpath(port, NULL)))
+    return;
+  tty = strrchr(dev, '/')? strrchr(dev, '/') + 1: dev;
+  snprintf(path, sizeof path, "/sys/class/tty/%s/device/driver", tty);
+  if((n = readlink(path, link, sizeof link - 1)) < 0) {
+    pmsg_notice2("%s is not a USB-serial adapter, not tuning it\n", port);
+    free(dev);
+    return;
+  }
+  link[n] = 0;
+  driver = strrchr(link, '/')? strrchr(link, '/') + 1: link;
+  if(strcmp(driver, "ftdi_sio") && !strstr(driver, "ch34") && strcmp(driver, "cp210x")) {
+    pmsg_notice2("%s uses driver %s, not tuning it\n", port, driver);
+    free(dev);
+    return;
+  }
+
+  tune.fd = fd;
+  tune.turnarounds = 0;
+  tune.sent = 0;
+
+  if(ioctl(fd, TIOCGSERIAL, &ss) == 0 && !(ss.flags & ASYNC_LOW_LATENCY)) {
+    int flags = ss.flags;
+
+    ss.flags |= ASYNC_LOW_LATENCY;
+    if(ioctl(fd, TIOCSSERIAL, &ss) == 0) {
+      tune.serial_flags = flags;
+      pmsg_notice("%s (%s): low-latency mode on\n", port, driver);
+    } else {
+      pmsg_notice2("cannot set low-latency mode of %s: %s\n", port, strerror(errno));
+    }
+  }
+
+  snprintf(path, sizeof path, "/sys/class/tty/%s/device/latency_timer", tty);
+  if(sysfs_read_int(path, &lat) == 0 && lat > 1) {
+    if(sysfs_write_int(path, 1) == 0) {
+      tune.latency_path = cfg_strdup(__func__, path);
+      tune.latency = lat;
+      pmsg_notice("%s (%s): latency timer %d ms -> 1 ms\n", port, driver, lat);
+      trace_info("latency_timer_ms", "1");
+    } else {
+      pmsg_notice("%s (%s): cannot set latency timer, now %d ms: %s\n", port, driver, lat, strerror(errno));
+    }
+  }
+
+  free(dev);
+}
+
+static void ser_untune(void) {
+  if(tune.latency_path) {
+    if(sysfs_write_int(tune.latency_path, tune.latency) < 0)
+      pmsg_ext_error("cannot restore latency timer: %s\n", strerror(errno));
+    pmsg_notice("latency timer restored to %d ms; %lu response%s arrived with 1 ms instead\n",
+      tune.latency, tune.turnarounds, update_plural(tune.turnarounds));
+    free(tune.latency_path);
+    tune.latency_path = NULL;
+    tune.latency = -1;
+  }
+  if(tune.serial_flags != -1) {
+    struct serial_struct ss;
+
+    if(ioctl(tune.fd, TIOCGSERIAL, &ss) == 0) {
+      ss.flags = tune.serial_flags;
+      if(ioctl(tune.fd, TIOCSSERIAL, &ss) < 0)
+        pmsg_notice2("cannot restore serial flags: %s\n", strerror(errno));
+    }
+    tune.serial_flags = -1;
+  }
+  tune.fd = -1;
+}
+
+#else
+
+static void ser_tune(const char *port, int fd) {
+  pmsg_notice("low-latency tuning of %s not supported on this platform\n", port);
+}
+
+static void ser_untune(void) {
+}
+
+#endif
+
+
 static int ser_open(const char *port, union pinfo pinfo, union filedescriptor *fdp) {
   int rc;
   int fd;
@@ -392,6 +759,8 @@ static int ser_open(const char *port, union pinfo pinfo, union filedescriptor *f
   if (strncmp(port, "net:", strlen("net:")) == 0) {
     return net_open(port + strlen("net:"), fdp);
   }
+  if (strncmp(port, "rfc2217:", strlen("rfc2217:")) == 0)
+    return rfc2217_open(port + strlen("rfc2217:"), pinfo.serialinfo.baud, pinfo.serialinfo.cflags, fdp);
 
   /*
    * open the serial port
@@ -413,10 +782,18 @@ static int ser_open(const char *port, union pinfo pinfo, union filedescriptor *f
     close(fd);
     return -1;
   }
+  if (serial_low_latency)
+    ser_tune(port, fd);
+
   return 0;
 }
 
 static void ser_close(union filedescriptor *fd) {
+  if (is_net(fd)) {
+    net_flush();
+    net.fd = -1;
+  }
+
   /*
    * restore original termios settings from ser_open
    */
@@ -428,6 +805,9 @@ static void ser_close(union filedescriptor *fd) {
     saved_original_termios = 0;
   }
 
+  if (tune.fd >= 0 && tune.fd == fd->ifd)
+    ser_untune();
+
   close(fd->ifd);
 }
 
@@ -461,6 +841,12 @@ static int ser_send(const union filedescriptor *fd, const unsigned char * buf, s
       msg_trace("\n");
   }
 
+  if (is_net(fd))
+    return net_queue(p, len, 0) < 0 || net_flush() < 0? -1: 0;
+
+  if (fd->ifd == tune.fd)
+    tune.sent = 1;
+
   while (len) {
     rc = write(fd->ifd, p, (len > 1024) ? 1024 : len);
     if (rc < 0) {
@@ -487,6 +873,14 @@ static int ser_recv(const union filedescriptor *fd, unsigned char * buf, size_t
   timeout.tv_usec = (serial_recv_timeout % 1000L) * 1000;
   to2 = timeout;
 
+  if (is_net(fd) && net_flush() < 0)
+    return -1;
+
+  if (tune.sent && fd->ifd == tune.fd) {
+    tune.turnarounds++;
+    tune.sent = 0;
+  }
+
   while (len < buflen) {
   reselect:
     FD_ZERO(&rfds);
@@ -513,6 +907,18 @@ static int ser_recv(const union filedescriptor *fd, unsigned char * buf, size_t
       pmsg_ext_error("unable to read: %s\n", strerror(errno));
       return -1;
     }
+    if (is_net(fd)) {
+      if (rc == 0) {
+        pmsg_error("connection closed by peer\n");
+        return -1;
+      }
+      net_quickack();
+      if (net.rfc2217) {
+        rc = net_filter(p, rc);
+        if (net.wlen && net_flush() < 0) // Answers to telnet option requests
+          return -1;
+      }
+    }
     p += rc;
     len += rc;
   }
@@ -553,6 +959,9 @@ static int ser_drain(const union filedescriptor *fd, int display) {
   timeout.tv_sec = 0;
   timeout.tv_usec = serial_drain_timeout*1000L;
 
+  if (is_net(fd) && net_flush() < 0)
+    return -1;
+
   if (display) {
     msg_info("drain>");
   }
@@ -585,6 +994,15 @@ static int ser_drain(const union filedescriptor *fd, int display) {
       pmsg_ext_error("unable to read: %s\n", strerror(errno));
       return -1;
     }
+    if (is_net(fd)) {
+      if (rc == 0)              // Peer closed connection: nothing left to drain
+        break;
+      if (net.rfc2217 && net_filter(&buf, 1) == 0) {
+        if (net.wlen && net_flush() < 0)
+          return -1;
+        continue;
+      }
+    }
     if (display) {
       msg_info("%02x ", buf);
     }
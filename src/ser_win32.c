@@ -42,6 +42,7 @@
 
 long serial_recv_timeout = 5000; /* ms */
 long serial_drain_timeout = 250; /* ms */
+int serial_low_latency;          /* Not supported: FTDI latency is a driver setting */
 
 #define W32SERBUFSIZE 1024
 
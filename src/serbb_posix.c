@@ -70,6 +70,50 @@ static char *serpins[DB9PINS + 1] =
   { "NONE", "CD", "RXD", "TXD", "DTR", "GND", "DSR", "RTS", "CTS", "RI" };
 #endif
 
+/*
+ * Shadow copies of the modem control word (without the input lines) and
+ * of the TXD break state: pin changes cost one TIOCMSET or TIOCxBRK ioctl
+ * and no TIOCMGET, and pins that do not change cost nothing; -1 means
+ * not yet known
+ */
+#define SERBB_INPUTS (TIOCM_CD | TIOCM_DSR | TIOCM_CTS | TIOCM_RI)
+
+static long ctlshadow = -1;
+static int brkshadow = -1;
+
+static int serbb_getctl(const PROGRAMMER *pgm, unsigned int *ctl) {
+  if (ioctl(pgm->fd.ifd, TIOCMGET, ctl) < 0) {
+    pmsg_ext_error("ioctl(\"TIOCMGET\"): %s\n", strerror(errno));
+    return -1;
+  }
+  ctlshadow = *ctl & ~SERBB_INPUTS;
+
+  return 0;
+}
+
+static int serbb_setctl(const PROGRAMMER *pgm, unsigned int ctl) {
+  if (ctlshadow == (long) ctl)
+    return 0;
+  if (ioctl(pgm->fd.ifd, TIOCMSET, &ctl) < 0) {
+    pmsg_ext_error("ioctl(\"TIOCMSET\"): %s\n", strerror(errno));
+    ctlshadow = -1;
+    return -1;
+  }
+  ctlshadow = ctl;
+
+  return 0;
+}
+
+// Modem control word ctl with DTR or RTS pin (possibly inverted) set to value
+static unsigned int serbb_ctlpin(unsigned int ctl, int pin, int value) {
+  if (pin & PIN_INVERSE) {
+    value = !value;
+    pin &= PIN_MASK;
+  }
+
+  return value? ctl | serregbits[pin]: ctl & ~serregbits[pin];
+}
+
 static int serbb_setpin(const PROGRAMMER *pgm, int pinfunc, int value) {
   unsigned int	ctl;
   int           r;
@@ -95,29 +139,23 @@ static int serbb_setpin(const PROGRAMMER *pgm, int pinfunc, int value) {
   switch ( pin )
   {
     case 3:  /* txd */
+      if (brkshadow == !!value)
+        break;
       r = ioctl(pgm->fd.ifd, value ? TIOCSBRK : TIOCCBRK, 0);
       if (r < 0) {
         pmsg_ext_error("ioctl(\"TIOCxBRK\"): %s\n", strerror(errno));
+        brkshadow = -1;
         return -1;
       }
+      brkshadow = !!value;
       break;
 
     case 4:  /* dtr */
     case 7:  /* rts */
-      r = ioctl(pgm->fd.ifd, TIOCMGET, &ctl);
-      if (r < 0) {
-        pmsg_ext_error("ioctl(\"TIOCMGET\"): %s\n", strerror(errno));
+      if (ctlshadow < 0 && serbb_getctl(pgm, &ctl) < 0)
         return -1;
-      }
-      if (value)
-        ctl |= serregbits[pin];
-      else
-        ctl &= ~(serregbits[pin]);
-      r = ioctl(pgm->fd.ifd, TIOCMSET, &ctl);
-      if (r < 0) {
-        pmsg_ext_error("ioctl(\"TIOCMSET\"): %s\n", strerror(errno));
+      if (serbb_setctl(pgm, serbb_ctlpin(ctlshadow, pin, value)) < 0)
         return -1;
-      }
       break;
 
     default: /* impossible */
@@ -133,7 +171,6 @@ static int serbb_setpin(const PROGRAMMER *pgm, int pinfunc, int value) {
 static int serbb_getpin(const PROGRAMMER *pgm, int pinfunc) {
   unsigned int	ctl;
   unsigned char invert;
-  int           r;
 
   if(pinfunc < 0 || pinfunc >= N_PINS)
     return -1;
@@ -159,11 +196,8 @@ static int serbb_getpin(const PROGRAMMER *pgm, int pinfunc) {
     case 6:  /* dsr */
     case 8:  /* cts */
     case 9:  /* ri  */
-      r = ioctl(pgm->fd.ifd, TIOCMGET, &ctl);
-      if (r < 0) {
-        pmsg_ext_error("ioctl(\"TIOCMGET\"): %s\n", strerror(errno));
+      if (serbb_getctl(pgm, &ctl) < 0)
         return -1;
-      }
       if ( !invert )
       {
 #ifdef DEBUG
@@ -201,6 +235,68 @@ static int serbb_highpulsepin(const PROGRAMMER *pgm, int pinfunc) {
 
 
 
+/*
+ * Transmit and receive one byte when both SDO and SCK are on DTR/RTS: the
+ * falling SCK edge of one bit and SDO of the next go out with the same
+ * TIOCMSET, so a bit costs two TIOCMSET and one TIOCMGET instead of seven
+ * ioctls. SDO is still set up before, and held during, the high SCK phase.
+ */
+static unsigned char serbb_txrx(const PROGRAMMER *pgm, unsigned char byte) {
+  int sdo = pgm->pinno[PIN_AVR_SDO], sck = pgm->pinno[PIN_AVR_SCK];
+  unsigned char r, rbyte = 0;
+  unsigned int ctl;
+
+  if (ctlshadow < 0 && serbb_getctl(pgm, &ctl) < 0)
+    return 0;
+
+  for (int i = 7; i >= 0; i--) {
+    ctl = serbb_ctlpin(serbb_ctlpin(ctlshadow, sck, 0), sdo, (byte >> i) & 1);
+    serbb_setctl(pgm, ctl);
+    if (pgm->ispdelay > 1)
+      bitbang_delay(pgm->ispdelay);
+
+    serbb_setctl(pgm, serbb_ctlpin(ctl, sck, 1));
+    if (pgm->ispdelay > 1)
+      bitbang_delay(pgm->ispdelay);
+
+    r = serbb_getpin(pgm, PIN_AVR_SDI);
+    rbyte |= r << i;
+  }
+
+  serbb_setctl(pgm, serbb_ctlpin(ctlshadow, sck, 0));
+  if (pgm->ispdelay > 1)
+    bitbang_delay(pgm->ispdelay);
+
+  return rbyte;
+}
+
+static int serbb_is_ctlpin(int pin) {
+  pin &= PIN_MASK;
+
+  return pin == 4 || pin == 7;
+}
+
+static int serbb_cmd(const PROGRAMMER *pgm, const unsigned char *cmd, unsigned char *res) {
+  if (!serbb_is_ctlpin(pgm->pinno[PIN_AVR_SDO]) || !serbb_is_ctlpin(pgm->pinno[PIN_AVR_SCK]))
+    return bitbang_cmd(pgm, cmd, res);
+
+  for (int i = 0; i < 4; i++)
+    res[i] = serbb_txrx(pgm, cmd[i]);
+
+  if (verbose >= 2) {
+    msg_notice2("serbb_cmd(): [ ");
+    for (int i = 0; i < 4; i++)
+      msg_notice2("%02X ", cmd[i]);
+    msg_notice2("] [ ");
+    for (int i = 0; i < 4; i++)
+      msg_notice2("%02X ", res[i]);
+    msg_notice2("]\n");
+  }
+
+  return 0;
+}
+
+
 static void serbb_display(const PROGRAMMER *pgm, const char *p) {
   /* MAYBE */
 }
@@ -232,6 +328,7 @@ static int serbb_open(PROGRAMMER *pgm, const char *port) {
   /* adapted from uisp code */
 
   pgm->fd.ifd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  ctlshadow = brkshadow = -1;
 
   if (pgm->fd.ifd < 0) {
     pmsg_ext_error("%s: %s\n", port, strerror(errno));
@@ -280,6 +377,7 @@ static void serbb_close(PROGRAMMER *pgm) {
 	  (void)tcsetattr(pgm->fd.ifd, TCSANOW, &oldmode);
 	  pgm->setpin(pgm, PIN_AVR_RESET, 1);
 	  close(pgm->fd.ifd);
+	  ctlshadow = brkshadow = -1;
   }
   return;
 }
@@ -303,7 +401,7 @@ void serbb_initpgm(PROGRAMMER *pgm) {
   pgm->powerdown      = serbb_powerdown;
   pgm->program_enable = bitbang_program_enable;
   pgm->chip_erase     = bitbang_chip_erase;
-  pgm->cmd            = bitbang_cmd;
+  pgm->cmd            = serbb_cmd;
   pgm->cmd_tpi        = bitbang_cmd_tpi;
   pgm->open           = serbb_open;
   pgm->close          = serbb_close;
@@ -0,0 +1,343 @@
+/*
+ * avrdude - A Downloader/Uploader for AVR device programmers
+ * Copyright (C) 2023 The AVRDUDE authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Server mode (-S <socket>): keep the programmer open, the part in
+ * programming mode and the r/w cache warm, and run jobs that clients
+ * send over a Unix domain or TCP socket. Clients are served one after
+ * the other in the order they connected; each one sends lines of
+ *
+ *   <memtype>:r|w|v:<filename>[:<format>]   as for -U, files are on the server side
+ *   erase                                   chip erase, otherwise done before the first flash
+ *                                           write of a client unless -D or -e were given
+ *   quit                                    end of job, same as closing the connection
+ *   shutdown                                end of job and server mode
+ *
+ * and receives one line per request: "ok" or "error". Diagnostics go to
+ * the server's stderr or log file as usual. Filenames are confined to the
+ * server's working directory: absolute paths, .. components, - for
+ * stdin/stdout and symbolic links that lead elsewhere are rejected. Unix
+ * domain sockets are only accessible to the user running the server.
+ */
+
+#include "ac_cfg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+#if !defined(WIN32)
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#endif
+
+#include "avrdude.h"
+#include "libavrdude.h"
+#include "server.h"
+
+#if !defined(WIN32)
+
+#define SERVER_LINELEN 1024
+
+/*
+ * Listen on where, which is a Unix domain socket path if it contains a
+ * slash and [<host>:]<port> otherwise; host defaults to localhost
+ */
+static int server_listen(const char *where) {
+  int fd = -1;
+
+  if(strchr(where, '/')) {
+    struct sockaddr_un sun;
+
+    if(strlen(where) >= sizeof sun.sun_path) {
+      pmsg_error("socket path %s too long\n", where);
+      return -1;
+    }
+    memset(&sun, 0, sizeof sun);
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, where);
+    unlink(where);
+    mode_t mask = umask(0077);  // Socket for the owner only
+    if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+      bind(fd, (struct sockaddr *) &sun, sizeof sun) < 0 || listen(fd, 16) < 0) {
+      pmsg_ext_error("cannot listen on %s: %s\n", where, strerror(errno));
+      if(fd >= 0)
+        close(fd);
+      fd = -1;
+    }
+    umask(mask);
+    return fd;
+  }
+
+  char *dup = cfg_strdup(__func__, where), *host = dup, *port = strrchr(dup, ':');
+  struct addrinfo hints, *res, *rp;
+  int s, one = 1;
+
+  if(port)
+    *port++ = 0;
+  else
+    port = host, host = NULL;
+
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if((s = getaddrinfo(host && *host? host: "localhost", port, &hints, &res)) != 0) {
+    pmsg_ext_error("cannot resolve %s: %s\n", where, gai_strerror(s));
+    free(dup);
+    return -1;
+  }
+  for(rp = res; rp; rp = rp->ai_next) {
+    if((fd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol)) < 0)
+      continue;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if(bind(fd, rp->ai_addr, rp->ai_addrlen) == 0 && listen(fd, 16) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  if(fd < 0)
+    pmsg_ext_error("cannot listen on %s: %s\n", where, strerror(errno));
+  freeaddrinfo(res);
+  free(dup);
+
+  return fd;
+}
+
+/*
+ * Wait until fd is readable, keeping bootloaders alive meanwhile as
+ * terminal mode does; returns 1 when readable, -1 on error
+ */
+static int server_wait(const PROGRAMMER *pgm, int fd) {
+  for(;;) {
+    struct timeval tv = { 0, 100000 };
+    fd_set rfds;
+    int n;
+
+    FD_ZERO(&rfds);
+    FD_SET(fd, &rfds);
+    if((n = select(fd+1, &rfds, NULL, NULL, &tv)) > 0)
+      return 1;
+    if(n < 0 && errno != EINTR) {
+      pmsg_ext_error("select(): %s\n", strerror(errno));
+      return -1;
+    }
+    if(pgm->term_keep_alive)
+      pgm->term_keep_alive(pgm, NULL);
+  }
+}
+
+/*
+ * Read a line from the client into buf; return its length, len if the line does not
+ * fit into buf (the rest of the line is consumed) or -1 at end of connection
+ */
+static int server_getline(const PROGRAMMER *pgm, int fd, char *buf, int len) {
+  int n = 0, toolong = 0;
+
+  for(;;) {
+    char c;
+
+    if(server_wait(pgm, fd) < 0 || read(fd, &c, 1) != 1)
+      return n && !toolong? n: -1;
+    if(c == '\n') {
+      if(n && buf[n-1] == '\r')
+        n--;
+      buf[n] = 0;
+      return toolong? len: n;
+    }
+    if(n < len-1)
+      buf[n++] = c;
+    else
+      toolong = 1;
+  }
+}
+
+/*
+ * Is fname a file within directory root (a real path)? The file itself need not exist
+ * yet, but its directory must.
+ */
+static int server_path_ok(const char *fname, const char *root) {
+  char *dup, *dir, *real;
+  size_t rlen = strlen(root);
+  int ok;
+
+  if(!*fname || !strcmp(fname, "-") || *fname == '/')
+    return 0;
+  for(const char *s = fname; (s = strstr(s, "..")); s += 2)
+    if((s == fname || s[-1] == '/') && (!s[2] || s[2] == '/'))
+      return 0;
+
+  if(!(real = realpath(fname, NULL))) { // Not (yet) there? Check its directory
+    dup = cfg_strdup(__func__, fname);
+    dir = strrchr(dup, '/');
+    if(dir)
+      *dir = 0;
+    real = realpath(dir? dup: ".", NULL);
+    free(dup);
+    if(!real)
+      return 0;
+  }
+  ok = !strncmp(real, root, rlen) && (real[rlen] == '/' || !real[rlen] || !strcmp(root, "/"));
+  free(real);
+
+  return ok;
+}
+
+static void server_reply(int fd, int ok) {
+  const char *r = ok? "ok\n": "error\n";
+
+  if(write(fd, r, strlen(r)) < 0)
+    pmsg_notice("unable to reply to client: %s\n", strerror(errno));
+}
+
+// Serve one client; returns 1 on shutdown request, 0 otherwise
+static int server_job(PROGRAMMER *pgm, AVRPART *p, int fd, enum updateflags flags, const char *root) {
+  char line[SERVER_LINELEN];
+  int njob = 0, nerr = 0, ret = 0, n;
+  const char *flashname = p->prog_modes & PM_PDI? "application": "flash";
+
+  // As in main(), auto-erase means a chip erase before the first flash write unless pages are erased
+  int autoerase = (flags & UF_AUTO_ERASE) && !(flags & UF_NOWRITE) &&
+    !((p->prog_modes & PM_PDI) && pgm->page_erase);
+  if(autoerase)
+    flags &= ~UF_AUTO_ERASE;
+
+  while((n = server_getline(pgm, fd, line, sizeof line)) >= 0) {
+    char *s = line + strspn(line, " \t");
+
+    if(n >= (int) sizeof line) {
+      pmsg_error("client request longer than %d characters, refusing it\n", (int) sizeof line - 1);
+      njob++;
+      nerr++;
+      server_reply(fd, 0);
+      continue;
+    }
+    if(!*s || *s == '#')
+      continue;
+    if(!strcmp(s, "quit"))
+      break;
+    if(!strcmp(s, "shutdown")) {
+      ret = 1;
+      break;
+    }
+
+    njob++;
+    if(!strcmp(s, "erase")) {
+      int rc = pgm->chip_erase_cached(pgm, p);
+      if(rc < 0)
+        nerr++;
+      else
+        autoerase = 0;
+      server_reply(fd, rc >= 0);
+      continue;
+    }
+
+    UPDATE *upd = parse_op(s);
+    if(!upd) {
+      nerr++;
+      server_reply(fd, 0);
+      continue;
+    }
+    if(upd->format != FMT_IMM && !server_path_ok(upd->filename, root)) {
+      pmsg_error("file %s is outside %s, refusing client request\n", upd->filename, root);
+      free_update(upd);
+      nerr++;
+      server_reply(fd, 0);
+      continue;
+    }
+    if(!upd->memtype)
+      upd->memtype = cfg_strdup(__func__, flashname);
+    const AVRMEM *m = avr_locate_mem(p, upd->memtype);
+    if(autoerase && upd->op == DEVICE_WRITE && m && !strcmp(m->desc, flashname)) {
+      pmsg_info("erasing chip before first %s write of client\n", flashname);
+      if(pgm->chip_erase_cached(pgm, p) < 0) {
+        free_update(upd);
+        nerr++;
+        server_reply(fd, 0);
+        continue;
+      }
+      autoerase = 0;
+    }
+    int rc = do_op(pgm, p, upd, flags);
+    free_update(upd);
+    if(rc && rc != LIBAVRDUDE_SOFTFAIL)
+      nerr++;
+    server_reply(fd, !rc || rc == LIBAVRDUDE_SOFTFAIL);
+  }
+
+  if(pgm->flush_cache(pgm, p) < 0)
+    nerr++;
+  pmsg_info("client done: %d request%s, %d failed\n", njob, update_plural(njob), nerr);
+
+  return ret;
+}
+
+
+int server_mode(PROGRAMMER *pgm, AVRPART *p, const char *where, enum updateflags flags) {
+  int lfd, cfd, done = 0;
+  void (*sigpipe)(int);
+  char *root;
+
+  if(!(root = realpath(".", NULL))) {
+    pmsg_ext_error("cannot determine working directory: %s\n", strerror(errno));
+    return 1;
+  }
+  if((lfd = server_listen(where)) < 0) {
+    free(root);
+    return 1;
+  }
+
+  sigpipe = signal(SIGPIPE, SIG_IGN); // Clients that went away must not kill the server
+  pmsg_info("serving %s requests on %s for files in %s\n", p->desc, where, root);
+  while(!done) {
+    if(server_wait(pgm, lfd) < 0)
+      break;
+    if((cfd = accept(lfd, NULL, NULL)) < 0) {
+      if(errno == EINTR)
+        continue;
+      pmsg_ext_error("accept(): %s\n", strerror(errno));
+      break;
+    }
+    done = server_job(pgm, p, cfd, flags, root);
+    close(cfd);
+  }
+
+  close(lfd);
+  if(strchr(where, '/'))
+    unlink(where);
+  signal(SIGPIPE, sigpipe);
+  free(root);
+
+  return done? 0: 1;
+}
+
+#else
+
+int server_mode(PROGRAMMER *pgm, AVRPART *p, const char *where, enum updateflags flags) {
+  pmsg_error("server mode is not available on this platform\n");
+  return 1;
+}
+
+#endif
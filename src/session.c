@@ -0,0 +1,241 @@
+/*
+ * avrdude - A Downloader/Uploader for AVR device programmers
+ * Copyright (C) 2023 The AVRDUDE authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Session API for applications that link libavrdude: open and initialise
+ * a programmer once, then run any number of memory operations and chip
+ * erases on it, and finally close it. Settings that are process-global in
+ * the library (verbose, quell_progress, ovsigck, update_progress and
+ * serdev) are kept per session and installed for the duration of each
+ * session call, so a long-lived process can drive several devices one
+ * after the other without interference. Session calls are not reentrant
+ * and must not run concurrently from different threads.
+ */
+
+#include "ac_cfg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "avrdude.h"
+#include "libavrdude.h"
+
+// Install the session's settings into the library globals
+static void session_enter(AVRSESSION *s) {
+  s->saved.verbose = verbose;
+  s->saved.quell_progress = quell_progress;
+  s->saved.ovsigck = ovsigck;
+  s->saved.progress = update_progress;
+  s->saved.serdev = serdev;
+
+  verbose = s->verbose;
+  quell_progress = s->quell_progress;
+  ovsigck = s->ovsigck;
+  update_progress = s->progress;
+  serdev = s->serdev;
+}
+
+// Restore the globals; keep the serial device as programmers select it in open()
+static void session_leave(AVRSESSION *s) {
+  s->serdev = serdev;
+
+  verbose = s->saved.verbose;
+  quell_progress = s->saved.quell_progress;
+  ovsigck = s->saved.ovsigck;
+  update_progress = s->saved.progress;
+  serdev = s->saved.serdev;
+}
+
+/*
+ * Create a session for programmer pgm, which the caller has located and
+ * set up with initpgm(), pgm->setup() and, where needed, parseextparams(),
+ * part p and port; settings default to the current global ones. The caller
+ * also remains responsible for pgm->teardown() after session_close().
+ */
+AVRSESSION *session_new(PROGRAMMER *pgm, const AVRPART *p, const char *port) {
+  AVRSESSION *s = cfg_malloc(__func__, sizeof *s);
+
+  s->pgm = pgm;
+  s->p = p;
+  s->port = cfg_strdup(__func__, port);
+  s->verbose = verbose;
+  s->quell_progress = quell_progress;
+  s->ovsigck = ovsigck;
+  s->progress = update_progress;
+  s->serdev = serdev;
+  s->flags = UF_VERIFY;
+
+  return s;
+}
+
+// Compare the device signature with that of the part
+static int session_signature(AVRSESSION *s) {
+  const AVRPART *p = s->p;
+  const AVRMEM *sig;
+  int rc;
+
+  if(p->prog_modes & PM_aWire)  // AVR32
+    return LIBAVRDUDE_SUCCESS;
+
+  if((rc = avr_signature(s->pgm, p)) != LIBAVRDUDE_SUCCESS) {
+    pmsg_error("unable to read signature data, rc=%d\n", rc);
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+  if(!(sig = avr_locate_mem(p, "signature")) || sig->size != 3) {
+    pmsg_warning("signature memory not defined for device %s\n", p->desc);
+    return LIBAVRDUDE_SUCCESS;
+  }
+
+  pmsg_info("device signature = 0x%02x%02x%02x\n", sig->buf[0], sig->buf[1], sig->buf[2]);
+  if(memcmp(sig->buf, p->signature, 3)) {
+    if(ovsigck) {
+      pmsg_warning("expected signature for %s is %02X %02X %02X\n", p->desc,
+        p->signature[0], p->signature[1], p->signature[2]);
+      return LIBAVRDUDE_SUCCESS;
+    }
+    pmsg_error("expected signature for %s is %02X %02X %02X\n", p->desc,
+      p->signature[0], p->signature[1], p->signature[2]);
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+
+  return LIBAVRDUDE_SUCCESS;
+}
+
+// Open the programmer, initialise the part and check its signature
+int session_open(AVRSESSION *s) {
+  PROGRAMMER *pgm = s->pgm;
+  const AVRPART *p = s->p;
+  AVRMEM *m;
+  int rc;
+
+  if(s->is_open)
+    return LIBAVRDUDE_SUCCESS;
+
+  session_enter(s);
+
+  if(p->mem && lfirst(p->mem) && (m = ldata(lfirst(p->mem))) && !m->buf && avr_initmem(p) != 0) {
+    pmsg_error("unable to initialize memories\n");
+    rc = LIBAVRDUDE_GENERAL_FAILURE;
+    goto done;
+  }
+
+  if(pgm->open(pgm, s->port) < 0) {
+    pmsg_error("unable to open programmer %s on port %s\n", (char *) ldata(lfirst(pgm->id)), s->port);
+    rc = LIBAVRDUDE_GENERAL_FAILURE;
+    goto done;
+  }
+  s->is_open = 1;
+
+  pgm->enable(pgm, p);
+  pgm->rdy_led(pgm, OFF);
+  pgm->err_led(pgm, OFF);
+  pgm->pgm_led(pgm, OFF);
+  pgm->vfy_led(pgm, OFF);
+
+  if((rc = pgm->initialize(pgm, p)) < 0) {
+    pmsg_error("initialization failed, rc=%d\n", rc);
+    rc = LIBAVRDUDE_GENERAL_FAILURE;
+    goto done;
+  }
+  pgm->rdy_led(pgm, ON);
+
+  // Only allow operations once the part is known to be the right one
+  if((rc = session_signature(s)) == LIBAVRDUDE_SUCCESS)
+    s->init_ok = 1;
+
+done:
+  session_leave(s);
+  return rc;
+}
+
+// Erase the chip; goes through the cache so its contents stay in step with the device
+int session_erase(AVRSESSION *s) {
+  int rc;
+
+  if(!s->init_ok)
+    return LIBAVRDUDE_GENERAL_FAILURE;
+
+  session_enter(s);
+  rc = s->pgm->chip_erase_cached(s->pgm, s->p);
+  session_leave(s);
+
+  return rc;
+}
+
+// Carry out memory operation upd, which remains owned by the caller
+int session_update(AVRSESSION *s, UPDATE *upd) {
+  int rc;
+
+  if(!s->init_ok)
+    return LIBAVRDUDE_GENERAL_FAILURE;
+
+  session_enter(s);
+  if(!upd->memtype)
+    upd->memtype = cfg_strdup(__func__, s->p->prog_modes & PM_PDI? "application": "flash");
+  rc = do_op(s->pgm, s->p, upd, s->flags);
+  session_leave(s);
+
+  return rc;
+}
+
+// Carry out a memory operation given in -U syntax <memtype>:r|w|v:<filename>[:<format>]
+int session_op(AVRSESSION *s, const char *spec) {
+  char *str = cfg_strdup(__func__, spec);
+  UPDATE *upd;
+  int rc;
+
+  session_enter(s);
+  upd = parse_op(str);
+  session_leave(s);
+  free(str);
+
+  if(!upd)
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  rc = session_update(s, upd);
+  free_update(upd);
+
+  return rc;
+}
+
+// Write back cached memory contents, close the programmer and free the session
+int session_close(AVRSESSION *s) {
+  PROGRAMMER *pgm;
+  int rc = LIBAVRDUDE_SUCCESS;
+
+  if(!s)
+    return rc;
+
+  pgm = s->pgm;
+
+  session_enter(s);
+  if(s->is_open) {
+    if(s->init_ok && pgm->flush_cache(pgm, s->p) < 0)
+      rc = LIBAVRDUDE_GENERAL_FAILURE;
+    pgm->powerdown(pgm);
+    pgm->disable(pgm);
+    pgm->rdy_led(pgm, OFF);
+    pgm->close(pgm);
+  }
+  session_leave(s);
+
+  free(s->port);
+  free(s);
+
+  return rc;
+}
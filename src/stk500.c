@@ -44,6 +44,8 @@
 
 #define STK500_XTAL 7372800U
 #define MAX_SYNC_ATTEMPTS 10
+#define STK500_PIPELINE_DEFAULT 4 // Pages in flight for -x pipeline
+#define STK500_PIPELINE_MAX 64
 
 static int stk500_getparm(const PROGRAMMER *pgm, unsigned parm, unsigned *value);
 static int stk500_setparm(const PROGRAMMER *pgm, unsigned parm, unsigned value);
@@ -562,7 +564,7 @@ static int stk500_parseextparms(const PROGRAMMER *pgm, const LISTID extparms)
  {
    LNODEID ln;
    const char *extended_param;
-   int attempts;
+   int attempts, pages;
    int rv = 0;
 
    for (ln = lfirst(extparms); ln; ln = lnext(ln)) {
@@ -574,6 +576,20 @@ static int stk500_parseextparms(const PROGRAMMER *pgm, const LISTID extparms)
        continue;
      }
 
+     if (strcmp(extended_param, "pipeline") == 0) {
+       PDATA(pgm)->pipeline = STK500_PIPELINE_DEFAULT;
+       continue;
+     }
+     if (sscanf(extended_param, "pipeline=%d", &pages) == 1) {
+       if (pages < 0 || pages > STK500_PIPELINE_MAX) {
+         pmsg_error("pipeline depth %d out of range [0, %d]\n", pages, STK500_PIPELINE_MAX);
+         rv = -1;
+         continue;
+       }
+       PDATA(pgm)->pipeline = pages;
+       continue;
+     }
+
      pmsg_error("invalid extended parameter '%s'\n", extended_param);
      rv = -1;
    }
@@ -782,6 +798,130 @@ static int set_memtype_a_div(const PROGRAMMER *pgm, const AVRPART *p, const AVRM
 }
 
 
+/*
+ * Pipelining (-x pipeline[=<n>]) for bootloaders that buffer enough of the serial stream,
+ * eg, optiboot v8+ or urboot: each page goes out as a single LOAD_ADDRESS + PROG_PAGE or
+ * LOAD_ADDRESS + READ_PAGE write, and up to n pages are sent before their responses are
+ * read with one serial_recv(). Only used for flash and when no extended address byte needs
+ * to be sent: bootloaders write EEPROM byte by byte without serving the UART, so a pipelined
+ * EEPROM page overruns their buffer, and the stray bytes might end up as flash commands.
+ */
+static int stk500_can_pipeline(const PROGRAMMER *pgm, const AVRMEM *m, int a_div) {
+  return PDATA(pgm)->pipeline > 0 && (pgm->prog_modes & PM_SPM) && avr_mem_is_flash_type(m) &&
+    m->size/a_div <= 64*1024 && strcmp(ldata(lfirst(pgm->id)), "mib510") != 0;
+}
+
+static int stk500_pipeline_addr(unsigned char *buf, unsigned int addr) {
+  buf[0] = Cmnd_STK_LOAD_ADDRESS;
+  buf[1] = addr & 0xff;
+  buf[2] = (addr >> 8) & 0xff;
+  buf[3] = Sync_CRC_EOP;
+
+  return 4;
+}
+
+// Bootloader got out of step: resync and switch pipelining off for the rest of the session
+static void stk500_pipeline_off(const PROGRAMMER *pgm) {
+  msg_warning("\n");
+  pmsg_warning("bootloader does not keep up with -x pipeline, continuing page by page\n");
+  PDATA(pgm)->pipeline = 0;
+  stk500_drain(pgm, 0);
+  stk500_getsync(pgm);
+}
+
+// Return number of bytes written from addr before the bootloader fell out of step (if at all)
+static unsigned int stk500_pipelined_write(const PROGRAMMER *pgm, const AVRMEM *m, int memtype,
+  int a_div, unsigned int page_size, unsigned int addr, unsigned int n) {
+
+  int depth = PDATA(pgm)->pipeline;
+  unsigned char *buf = cfg_malloc(__func__, depth*(page_size + 9)), *resp = cfg_malloc(__func__, 4*depth);
+  unsigned int start = addr;
+
+  while(addr < n) {
+    unsigned int a = addr, len = 0, block_size;
+    int k, i;
+
+    for(k = 0; k < depth && a < n; k++, a += block_size) {
+      block_size = n - a < page_size? n - a: page_size;
+      len += stk500_pipeline_addr(buf+len, a/a_div);
+      buf[len++] = Cmnd_STK_PROG_PAGE;
+      buf[len++] = (block_size >> 8) & 0xff;
+      buf[len++] = block_size & 0xff;
+      buf[len++] = memtype;
+      memcpy(buf+len, m->buf+a, block_size);
+      len += block_size;
+      buf[len++] = Sync_CRC_EOP;
+    }
+
+    if(stk500_send(pgm, buf, len) < 0 || stk500_recv(pgm, resp, 4*k) < 0)
+      break;
+    for(i = 0; i < 4*k; i += 2)
+      if(resp[i] != Resp_STK_INSYNC || resp[i+1] != Resp_STK_OK)
+        break;
+    if(i < 4*k)
+      break;
+    addr = a;
+  }
+
+  if(addr < n)
+    stk500_pipeline_off(pgm);
+  free(resp);
+  free(buf);
+
+  return addr - start;
+}
+
+// Return number of bytes read from addr before the bootloader fell out of step (if at all)
+static unsigned int stk500_pipelined_load(const PROGRAMMER *pgm, const AVRMEM *m, int memtype,
+  int a_div, unsigned int page_size, unsigned int addr, unsigned int n) {
+
+  int depth = PDATA(pgm)->pipeline;
+  unsigned char *buf = cfg_malloc(__func__, 9*depth), *resp = cfg_malloc(__func__, depth*(page_size + 4));
+  unsigned int start = addr;
+
+  while(addr < n) {
+    unsigned int a, len = 0, block_size;
+    int k;
+
+    for(k = 0, a = addr; k < depth && a < n; k++, a += block_size) {
+      block_size = n - a < page_size? n - a: page_size;
+      len += stk500_pipeline_addr(buf+len, a/a_div);
+      buf[len++] = Cmnd_STK_READ_PAGE;
+      buf[len++] = (block_size >> 8) & 0xff;
+      buf[len++] = block_size & 0xff;
+      buf[len++] = memtype;
+      buf[len++] = Sync_CRC_EOP;
+    }
+
+    // Each page answers INSYNC OK for the address and INSYNC <data> OK for the read
+    unsigned int end = a, rlen = (end - addr) + 4*k;
+    unsigned char *r = resp;
+
+    if(stk500_send(pgm, buf, len) < 0 || stk500_recv(pgm, resp, rlen) < 0)
+      break;
+    for(a = addr; a < end; a += block_size, r += block_size + 4) {
+      block_size = end - a < page_size? end - a: page_size;
+      if(r[0] != Resp_STK_INSYNC || r[1] != Resp_STK_OK || r[2] != Resp_STK_INSYNC ||
+        r[3+block_size] != Resp_STK_OK)
+        break;
+    }
+    if(a < end)
+      break;
+    for(r = resp; addr < end; addr += block_size, r += block_size + 4) {
+      block_size = end - addr < page_size? end - addr: page_size;
+      memcpy(m->buf+addr, r+3, block_size);
+    }
+  }
+
+  if(addr < n)
+    stk500_pipeline_off(pgm);
+  free(resp);
+  free(buf);
+
+  return addr - start;
+}
+
+
 static int stk500_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const AVRMEM *m,
                               unsigned int page_size,
                               unsigned int addr, unsigned int n_bytes)
@@ -807,6 +947,9 @@ static int stk500_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const AVR
     n_bytes, n, a_div, page_size);
 #endif
 
+  if(stk500_can_pipeline(pgm, m, a_div))
+    addr += stk500_pipelined_write(pgm, m, memtype, a_div, page_size, addr, n);
+
   for (; addr < n; addr += block_size) {
     // MIB510 uses fixed blocks size of 256 bytes
     if (strcmp(ldata(lfirst(pgm->id)), "mib510") == 0) {
@@ -879,6 +1022,9 @@ static int stk500_paged_load(const PROGRAMMER *pgm, const AVRPART *p, const AVRM
     return -2;
 
   n = addr + n_bytes;
+  if(stk500_can_pipeline(pgm, m, a_div))
+    addr += stk500_pipelined_load(pgm, m, memtype, a_div, page_size, addr, n);
+
   for (; addr < n; addr += block_size) {
     // MIB510 uses fixed blocks size of 256 bytes
     if (strcmp(ldata(lfirst(pgm->id)), "mib510") == 0) {
@@ -42,6 +42,7 @@ struct pdata {
   unsigned char ext_addr_byte;  // Record ext-addr byte set in the target device (if used)
   int retry_attempts;           // Number of connection attempts provided by the user
   int xbeeResetPin;             // Piggy back variable used by xbee programmmer
+  int pipeline;                 // Max number of pages in flight for bootloaders (-x pipeline)
 };
 
 #define PDATA(pgm) ((struct pdata *)(pgm->cookie))
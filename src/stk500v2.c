@@ -781,6 +781,7 @@ static int stk500v2_command(const PROGRAMMER *pgm, unsigned char *buf,
                             size_t len, size_t maxlen) {
   int tries = 0;
   int status;
+  unsigned char cmd = buf[0];   // buf is overwritten by the answer
 
   DEBUG("STK500V2: stk500v2_command(");
   for (size_t i=0; i<len; i++)
@@ -790,10 +791,12 @@ static int stk500v2_command(const PROGRAMMER *pgm, unsigned char *buf,
 retry:
   tries++;
 
+  trace_begin("stk500v2_command", cmd);
   // send the command to the programmer
   stk500v2_send(pgm,buf,len);
   // attempt to read the status back
   status = stk500v2_recv(pgm,buf,maxlen);
+  trace_end("stk500v2_command", cmd);
 
   DEBUG("STK500V2: stk500v2_command() received content: [ ");
   for (size_t i=0; i<len; i++)
@@ -77,6 +77,16 @@ typedef struct pdata
     // State
     bool erase_flash;
     bool reboot;
+    bool erased;                // flash erased, so blank pages need not be written
+    // HID report buffer, allocated once
+    uint8_t* report;
+    size_t report_size;
+    // Upload statistics
+    unsigned long start_us;     // time of first page write
+    unsigned long end_us;       // time of last page write
+    uint32_t bytes_written;
+    uint32_t pages_written;
+    uint32_t pages_skipped;
 } pdata_t;
 
 //-----------------------------------------------------------------------------
@@ -176,13 +186,21 @@ static int teensy_write_page(pdata_t* pdata, uint32_t address, const uint8_t* bu
     }
 
     size_t report_size = 1 + 2 + (size_t)pdata->page_size;
-    uint8_t* report = (uint8_t*)malloc(report_size);
-    if (report == NULL)
+    if (pdata->report_size != report_size)
     {
-        pmsg_error("unable to allocate memory\n");
-        return -1;
+        uint8_t* report = (uint8_t*)realloc(pdata->report, report_size);
+        if (report == NULL)
+        {
+            pmsg_error("unable to allocate memory\n");
+            return -1;
+        }
+
+        pdata->report = report;
+        pdata->report_size = report_size;
     }
 
+    uint8_t* report = pdata->report;
+
     report[0] = 0; // report number
     if (pdata->page_size <= 256 && pdata->flash_size < 0x10000)
     {
@@ -203,7 +221,6 @@ static int teensy_write_page(pdata_t* pdata, uint32_t address, const uint8_t* bu
     memset(report + 1 + 2 + size, 0xFF, report_size - (1 + 2 + size));
 
     int result = hid_write(pdata->hid_handle, report, report_size);
-    free(report);
     if (result < 0)
     {
         if (!suppress_warning)
@@ -212,9 +229,49 @@ static int teensy_write_page(pdata_t* pdata, uint32_t address, const uint8_t* bu
         return result;
     }
 
+    // The bootloader erases the whole flash when page 0 is written.
+    if (address == 0)
+    {
+        pdata->erased = true;
+    }
+
     return 0;
 }
 
+static bool teensy_is_blank(const uint8_t* buffer, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+    {
+        if (buffer[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void teensy_report_speed(pdata_t* pdata)
+{
+    if (pdata->pages_written == 0)
+    {
+        return;
+    }
+
+    double seconds = (pdata->end_us - pdata->start_us) / 1e6;
+    pmsg_notice("wrote %u bytes in %u pages (%u blank pages skipped) in %.3f s",
+      pdata->bytes_written, pdata->pages_written, pdata->pages_skipped, seconds);
+    if (seconds > 0)
+    {
+        msg_notice(", %.1f KiB/s", pdata->bytes_written / 1024.0 / seconds);
+    }
+    msg_notice("\n");
+
+    pdata->pages_written = 0;
+    pdata->pages_skipped = 0;
+    pdata->bytes_written = 0;
+}
+
 static int teensy_erase_flash(pdata_t* pdata)
 {
     pmsg_debug("teensy_erase_flash()\n");
@@ -249,6 +306,13 @@ static void teensy_setup(PROGRAMMER* pgm)
 static void teensy_teardown(PROGRAMMER* pgm)
 {
     pmsg_debug("teensy_teardown()\n");
+
+    pdata_t* pdata = PDATA(pgm);
+    if (pdata != NULL)
+    {
+        free(pdata->report);
+    }
+
     free(pgm->cookie);
 }
 
@@ -279,6 +343,8 @@ static void teensy_powerdown(const PROGRAMMER *pgm) {
 
     pdata_t* pdata = PDATA(pgm);
 
+    teensy_report_speed(pdata);
+
     if (pdata->erase_flash)
     {
         teensy_erase_flash(pdata);
@@ -531,12 +597,29 @@ static int teensy_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const AVR
             pdata->erase_flash = false;
         }
 
+        // An erased page already reads 0xFF; page 0 always goes out as it triggers the erase
+        if (pdata->erased && addr != 0 && teensy_is_blank(mem->buf + addr, n_bytes))
+        {
+            pmsg_debug("skipping blank page at 0x%06X\n", addr);
+            pdata->pages_skipped++;
+            return 0;
+        }
+
+        if (pdata->pages_written == 0)
+        {
+            pdata->start_us = avr_ustimestamp();
+        }
+
         int result = teensy_write_page(pdata, addr, mem->buf + addr, n_bytes, false);
         if (result < 0)
         {
             return result;
         }
 
+        pdata->end_us = avr_ustimestamp();
+        pdata->pages_written++;
+        pdata->bytes_written += n_bytes;
+
         // Schedule a reboot.
         pdata->reboot = true;
 
@@ -0,0 +1,486 @@
+/*
+ * avrdude - A Downloader/Uploader for AVR device programmers
+ * Copyright (C) 2023 The AVRDUDE authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Binary I/O tracer (-R <tracefile>)
+ *
+ * Records timestamped chunks sent to and received from the programmer via
+ * serial_send() and serial_recv() as well as the begin and end of
+ * programmer commands and memory operations into a ring buffer in memory.
+ * Recording costs a gettimeofday() and a memcpy() per event, so, unlike the
+ * byte-by-byte dumps of -vvvv, it does not noticeably change the timing of
+ * the link. When the ring is full the oldest events are dropped. The ring
+ * is written to the trace file on exit, which tools/trace-decode.c renders
+ * as text or as Chrome trace JSON.
+ *
+ * File format, all numbers little endian:
+ *
+ *   "AVRTRC1\n"   magic
+ *   u32 u32       start time of trace in s and us since the epoch
+ *   u32 u32       number of records in file, number of records dropped
+ *   records       u32 us since start, u8 type, u8 code, u16 len, len bytes
+ *
+ * Type is one of TRACE_TX, TRACE_RX, TRACE_BEGIN and TRACE_END; for TX and
+ * RX code is 0 on success and 1 on error, and the data are the bytes on
+ * the wire; for BEGIN and END code is the command byte or 0xff, and the
+ * data are the name of the command or operation.
+ *
+ * Performance report (-T <reportfile>)
+ *
+ * Accumulates wall-clock time per phase (config, file parse, open,
+ * initialize, signature, erase, read, write, verify, ...) together with
+ * the number of serial_send() and serial_recv() calls and bytes in each
+ * phase, and the latency of every paged read and write, and writes them
+ * as JSON on exit so that runs can be compared across programmer firmware
+ * and avrdude versions.
+ */
+
+#include "ac_cfg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#include "avrdude.h"
+#include "libavrdude.h"
+
+#define TRACE_MAGIC "AVRTRC1\n"
+#define TRACE_HDRLEN 8
+
+int trace_active;               // TRACE_RING | TRACE_STATS
+
+static struct {
+  char *fname;                  // Trace file
+  unsigned char *ring;          // Ring buffer of records
+  size_t size, tail, used;      // Size of ring, start of oldest record, bytes in use
+  size_t chunk;                 // Maximum data length of one record
+  unsigned long nrec, dropped;  // Records in ring and records overwritten
+  struct timeval t0;            // Start of trace
+} trace;
+
+#define STATS_MAXPHASE 32
+#define STATS_MAXINFO 16
+
+typedef struct {                // Counters for serial_send() and serial_recv()
+  unsigned long nsend, nrecv, nerr;
+  unsigned long long bsend, brecv;
+} Iocount;
+
+typedef struct {                // Latencies of paged reads or writes in us
+  unsigned long *us;
+  size_t n, max;
+} Pagelat;
+
+static struct {
+  char *fname;                  // Report file
+  struct timeval t0;            // Start of statistics
+  unsigned long long since;     // Start of current phase in us since t0
+  int cur, nphase;              // Current phase or -1, number of phases seen
+  struct {
+    const char *name;
+    int count;
+    unsigned long long us;
+    Iocount io;
+  } phase[STATS_MAXPHASE];
+  Iocount io, mark;             // All I/O, I/O at start of current phase
+  Pagelat page[2];              // Paged reads and writes
+  int ninfo;
+  struct { const char *key; char *val; } info[STATS_MAXINFO];
+} stats;
+
+static unsigned long long us_since(const struct timeval *t0) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (tv.tv_sec - t0->tv_sec)*1000000ULL + tv.tv_usec - t0->tv_usec;
+}
+
+static void ring_put(size_t pos, const void *src, size_t n) {
+  size_t k = trace.size - pos;
+
+  if(n <= k)
+    memcpy(trace.ring + pos, src, n);
+  else {
+    memcpy(trace.ring + pos, src, k);
+    memcpy(trace.ring, (const unsigned char *) src + k, n - k);
+  }
+}
+
+static void ring_get(size_t pos, void *dst, size_t n) {
+  size_t k = trace.size - pos;
+
+  if(n <= k)
+    memcpy(dst, trace.ring + pos, n);
+  else {
+    memcpy(dst, trace.ring + pos, k);
+    memcpy((unsigned char *) dst + k, trace.ring, n - k);
+  }
+}
+
+static size_t rec_len(size_t pos) {
+  unsigned char hdr[TRACE_HDRLEN];
+
+  ring_get(pos, hdr, sizeof hdr);
+  return TRACE_HDRLEN + (hdr[6] | hdr[7] << 8);
+}
+
+static void set32(unsigned char *p, unsigned long v) {
+  p[0] = v, p[1] = v >> 8, p[2] = v >> 16, p[3] = v >> 24;
+}
+
+// Start tracing into a ring of ringsize bytes that is dumped to fname on trace_close()
+int trace_open(const char *fname, size_t ringsize) {
+  if(trace_active & TRACE_RING)
+    return -1;
+
+  if(ringsize < 4096)
+    ringsize = 4096;
+  trace.fname = cfg_strdup(__func__, fname);
+  trace.ring = cfg_malloc(__func__, ringsize);
+  trace.size = ringsize;
+  trace.tail = trace.used = 0;
+  trace.chunk = ringsize/4 < 0xffff? ringsize/4: 0xffff;
+  trace.nrec = trace.dropped = 0;
+  gettimeofday(&trace.t0, NULL);
+  trace_active |= TRACE_RING;
+
+  return 0;
+}
+
+// Append a record to the ring; data longer than the chunk size are split
+void trace_record(int type, int code, const void *data, size_t len) {
+  const unsigned char *d = data;
+  unsigned char hdr[TRACE_HDRLEN];
+
+  if(!(trace_active & TRACE_RING))
+    return;
+
+  set32(hdr, us_since(&trace.t0));
+  hdr[4] = type;
+  hdr[5] = code;
+
+  do {
+    size_t n = len < trace.chunk? len: trace.chunk, head;
+
+    while(trace.used + TRACE_HDRLEN + n > trace.size) { // Drop oldest records
+      size_t r = rec_len(trace.tail);
+      trace.tail = (trace.tail + r) % trace.size;
+      trace.used -= r;
+      trace.nrec--;
+      trace.dropped++;
+    }
+
+    hdr[6] = n, hdr[7] = n >> 8;
+    head = (trace.tail + trace.used) % trace.size;
+    ring_put(head, hdr, TRACE_HDRLEN);
+    if(n)
+      ring_put((head + TRACE_HDRLEN) % trace.size, d, n);
+    trace.used += TRACE_HDRLEN + n;
+    trace.nrec++;
+    d += n;
+    len -= n;
+  } while(len);
+}
+
+void trace_begin(const char *name, int code) {
+  if(trace_active & TRACE_RING)
+    trace_record(TRACE_BEGIN, code & 0xff, name, strlen(name));
+}
+
+void trace_end(const char *name, int code) {
+  if(trace_active & TRACE_RING)
+    trace_record(TRACE_END, code & 0xff, name, strlen(name));
+}
+
+// Send via the current serial device and record the chunk
+int trace_send(const union filedescriptor *fd, const unsigned char *buf, size_t len) {
+  int rc = serdev->send(fd, buf, len);
+
+  if(trace_active) {
+    trace_record(TRACE_TX, rc < 0, buf, len);
+    stats.io.nsend++;
+    stats.io.bsend += len;
+    stats.io.nerr += rc < 0;
+  }
+
+  return rc;
+}
+
+/*
+ * Receive via the current serial device and record the chunk; serial
+ * ports return 0 when all len bytes were read, frame-oriented USB devices
+ * the number of bytes read
+ */
+int trace_recv(const union filedescriptor *fd, unsigned char *buf, size_t len) {
+  int rc = serdev->recv(fd, buf, len);
+
+  if(trace_active) {
+    size_t n = rc < 0? 0: rc > 0 && (size_t) rc < len? (size_t) rc: len;
+
+    trace_record(TRACE_RX, rc < 0, buf, n);
+    stats.io.nrecv++;
+    stats.io.brecv += n;
+    stats.io.nerr += rc < 0;
+  }
+
+  return rc;
+}
+
+// Start collecting statistics for a performance report written to fname on trace_close()
+int trace_report_open(const char *fname) {
+  if(trace_active & TRACE_STATS)
+    return -1;
+
+  memset(&stats, 0, sizeof stats);
+  stats.fname = cfg_strdup(__func__, fname);
+  stats.cur = -1;
+  gettimeofday(&stats.t0, NULL);
+  trace_active |= TRACE_STATS;
+
+  return 0;
+}
+
+static void io_add(Iocount *sum, const Iocount *now, const Iocount *then) {
+  sum->nsend += now->nsend - then->nsend;
+  sum->nrecv += now->nrecv - then->nrecv;
+  sum->nerr += now->nerr - then->nerr;
+  sum->bsend += now->bsend - then->bsend;
+  sum->brecv += now->brecv - then->brecv;
+}
+
+// End the current phase and start phase name (a string constant), or none if name is NULL
+void trace_phase(const char *name) {
+  unsigned long long now;
+
+  if(!(trace_active & TRACE_STATS))
+    return;
+
+  now = us_since(&stats.t0);
+  if(stats.cur >= 0) {
+    stats.phase[stats.cur].us += now - stats.since;
+    io_add(&stats.phase[stats.cur].io, &stats.io, &stats.mark);
+  }
+
+  stats.cur = -1;
+  if(name) {
+    int i;
+
+    for(i = 0; i < stats.nphase; i++)
+      if(!strcmp(stats.phase[i].name, name))
+        break;
+    if(i == stats.nphase) {
+      if(i == STATS_MAXPHASE)
+        return;
+      stats.phase[stats.nphase++].name = name;
+    }
+    stats.cur = i;
+    stats.phase[i].count++;
+  }
+  stats.since = now;
+  stats.mark = stats.io;
+}
+
+// Record the latency of a paged read (write = 0) or paged write (write = 1)
+void trace_page(int write, unsigned long us) {
+  Pagelat *pl;
+
+  if(!(trace_active & TRACE_STATS))
+    return;
+
+  pl = stats.page + !!write;
+  if(pl->n == pl->max) {
+    pl->max = pl->max? 2*pl->max: 1024;
+    pl->us = cfg_realloc(__func__, pl->us, pl->max * sizeof *pl->us);
+  }
+  pl->us[pl->n++] = us;
+}
+
+// Add a key (a string constant) and value to the report
+void trace_info(const char *key, const char *val) {
+  if(!(trace_active & TRACE_STATS) || !val)
+    return;
+
+  for(int i = 0; i < stats.ninfo; i++)
+    if(!strcmp(stats.info[i].key, key)) {
+      free(stats.info[i].val);
+      stats.info[i].val = cfg_strdup(__func__, val);
+      return;
+    }
+  if(stats.ninfo < STATS_MAXINFO) {
+    stats.info[stats.ninfo].key = key;
+    stats.info[stats.ninfo++].val = cfg_strdup(__func__, val);
+  }
+}
+
+static void json_str(FILE *f, const char *s) {
+  fputc('"', f);
+  for(; *s; s++)
+    if(*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if((unsigned char) *s < 0x20)
+      fprintf(f, "\\u%04x", *s);
+    else
+      fputc(*s, f);
+  fputc('"', f);
+}
+
+static void json_io(FILE *f, const Iocount *io) {
+  fprintf(f, "\"sends\": %lu, \"recvs\": %lu, \"errors\": %lu, "
+    "\"bytes_sent\": %llu, \"bytes_received\": %llu",
+    io->nsend, io->nrecv, io->nerr, io->bsend, io->brecv);
+}
+
+static int cmp_ulong(const void *a, const void *b) {
+  unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+
+  return x < y? -1: x > y;
+}
+
+static void json_pages(FILE *f, Pagelat *pl) {
+  unsigned long long sum = 0;
+  unsigned long hist[32] = {0};
+  int nhist = 0;
+
+  fprintf(f, "{\"count\": %lu", (unsigned long) pl->n);
+  if(pl->n) {
+    qsort(pl->us, pl->n, sizeof *pl->us, cmp_ulong);
+    for(size_t i = 0; i < pl->n; i++) {
+      int b = 0;
+      sum += pl->us[i];
+      while(b < 31 && pl->us[i] >= 2UL << b)
+        b++;
+      hist[b]++;
+      if(b >= nhist)
+        nhist = b+1;
+    }
+    fprintf(f, ", \"min_us\": %lu, \"mean_us\": %llu, \"p50_us\": %lu, \"p90_us\": %lu, "
+      "\"p99_us\": %lu, \"max_us\": %lu, \"log2_histogram_us\": [",
+      pl->us[0], sum/pl->n, pl->us[pl->n*50/100], pl->us[pl->n*90/100],
+      pl->us[pl->n*99/100], pl->us[pl->n-1]);
+    for(int b = 0; b < nhist; b++)
+      fprintf(f, "%s%lu", b? ", ": "", hist[b]);
+    fprintf(f, "]");
+  }
+  fprintf(f, "}");
+}
+
+// Write the performance report
+static int report_close(void) {
+  FILE *f;
+  int rc = 0;
+
+  trace_phase(NULL);
+
+  if(!(f = fopen(stats.fname, "w"))) {
+    pmsg_ext_error("cannot write report file %s: %s\n", stats.fname, strerror(errno));
+    rc = -1;
+    goto done;
+  }
+
+  fprintf(f, "{\n");
+  for(int i = 0; i < stats.ninfo; i++) {
+    fprintf(f, "  \"%s\": ", stats.info[i].key);
+    json_str(f, stats.info[i].val);
+    fprintf(f, ",\n");
+  }
+  fprintf(f, "  \"total_us\": %llu,\n  \"io\": {", us_since(&stats.t0));
+  json_io(f, &stats.io);
+  fprintf(f, "},\n  \"phases\": [\n");
+  for(int i = 0; i < stats.nphase; i++) {
+    fprintf(f, "    {\"name\": \"%s\", \"count\": %d, \"us\": %llu, ",
+      stats.phase[i].name, stats.phase[i].count, stats.phase[i].us);
+    json_io(f, &stats.phase[i].io);
+    fprintf(f, "}%s\n", i < stats.nphase-1? ",": "");
+  }
+  fprintf(f, "  ],\n  \"pages\": {\n    \"read\": ");
+  json_pages(f, stats.page+0);
+  fprintf(f, ",\n    \"write\": ");
+  json_pages(f, stats.page+1);
+  fprintf(f, "\n  }\n}\n");
+
+  if(fclose(f) != 0) {
+    pmsg_ext_error("cannot write report file %s: %s\n", stats.fname, strerror(errno));
+    rc = -1;
+  }
+
+done:
+  for(int i = 0; i < stats.ninfo; i++)
+    free(stats.info[i].val);
+  free(stats.page[0].us);
+  free(stats.page[1].us);
+  free(stats.fname);
+  memset(&stats, 0, sizeof stats);
+
+  return rc;
+}
+
+// Stop tracing and write the ring to the trace file and the performance report
+int trace_close(void) {
+  unsigned char hdr[24], rec[TRACE_HDRLEN + 0xffff];
+  size_t pos;
+  FILE *f;
+  int rc = 0, rcreport = 0;
+
+  if(trace_active & TRACE_STATS)
+    rcreport = report_close();
+  if(!(trace_active & TRACE_RING)) {
+    trace_active = 0;
+    return rcreport;
+  }
+  trace_active = 0;
+
+  if(!(f = fopen(trace.fname, "wb"))) {
+    pmsg_ext_error("cannot write trace file %s: %s\n", trace.fname, strerror(errno));
+    rc = -1;
+    goto done;
+  }
+
+  memcpy(hdr, TRACE_MAGIC, 8);
+  set32(hdr+8, trace.t0.tv_sec);
+  set32(hdr+12, trace.t0.tv_usec);
+  set32(hdr+16, trace.nrec);
+  set32(hdr+20, trace.dropped);
+  if(fwrite(hdr, 1, sizeof hdr, f) != sizeof hdr)
+    rc = -1;
+
+  pos = trace.tail;
+  for(unsigned long i = 0; i < trace.nrec && rc == 0; i++) {
+    size_t r = rec_len(pos);
+    ring_get(pos, rec, r);
+    if(fwrite(rec, 1, r, f) != r)
+      rc = -1;
+    pos = (pos + r) % trace.size;
+  }
+
+  if(fclose(f) != 0 || rc < 0) {
+    pmsg_ext_error("cannot write trace file %s: %s\n", trace.fname, strerror(errno));
+    rc = -1;
+  } else
+    pmsg_notice("wrote %lu trace record%s to %s (%lu dropped)\n", trace.nrec,
+      update_plural(trace.nrec), trace.fname, trace.dropped);
+
+done:
+  free(trace.ring);
+  free(trace.fname);
+  trace.ring = NULL;
+  trace.fname = NULL;
+
+  return rc < 0? rc: rcreport;
+}
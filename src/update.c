@@ -103,8 +103,8 @@ UPDATE * parse_op(char * s)
   p = strrchr(cp, ':');
   if (p == NULL) {
     // missing format, default to "AUTO" for write and verify,
-    // and to binary for read operations:
-    upd->format = upd->op == DEVICE_READ? FMT_RBIN: FMT_AUTO;
+    // and to binary (sparse image for all memories) for read operations:
+    upd->format = upd->op != DEVICE_READ? FMT_AUTO: strcmp(upd->memtype, "all")? FMT_RBIN: FMT_SPARSE;
     fnlen = strlen(cp);
     upd->filename = (char *) cfg_malloc("parse_op()", fnlen + 1);
   } else {
@@ -121,6 +121,7 @@ UPDATE * parse_op(char * s)
       case 'I': upd->format = FMT_IHXC; break;
       case 'r': upd->format = FMT_RBIN; break;
       case 'e': upd->format = FMT_ELF; break;
+      case 'x': upd->format = FMT_SPARSE; break;
       case 'm': upd->format = FMT_IMM; break;
       case 'b': upd->format = FMT_BIN; break;
       case 'd': upd->format = FMT_DEC; break;
@@ -153,6 +154,7 @@ UPDATE * dup_update(UPDATE * upd)
   else
     u->memtype = NULL;
   u->filename = cfg_strdup("dup_update()", upd->filename);
+  u->preload = NULL;
 
   return u;
 }
@@ -182,6 +184,8 @@ void free_update(UPDATE * u)
 	    free(u->filename);
 	    u->filename = NULL;
 	}
+	if(u->preload != NULL)
+	    avr_free_mem(u->preload);
 	free(u);
     }
 }
@@ -343,18 +347,60 @@ static void ioerror(const char *iotype, const UPDATE *upd) {
   msg_ext_error("\n");
 }
 
-// Basic checks to reveal serious failure before programming
+// Read the input file of a write or verify update ahead of device operations
+static int update_preload(const AVRPART *p, UPDATE *upd) {
+  AVRMEM *mem = avr_locate_mem(p, upd->memtype);
+  int rc;
+
+  pmsg_notice2("reading input file %s for %s ahead of programming\n",
+    update_inname(upd->filename), upd->memtype);
+  rc = fileio(upd->op == DEVICE_VERIFY? FIO_READ_FOR_VERIFY: FIO_READ,
+    upd->filename, upd->format, p, upd->memtype, -1);
+  if(rc < 0) {
+    pmsg_error("read from file %s failed\n", update_inname(upd->filename));
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+  upd->preload = avr_dup_mem(mem);
+  upd->presize = rc;
+
+  return LIBAVRDUDE_SUCCESS;
+}
+
+// Put the input file contents of upd into mem: use the copy read by update_dryrun() if any
+static int update_readfile(const AVRPART *p, const UPDATE *upd, const AVRMEM *mem, int oprwv) {
+  if(upd->preload) {
+    memcpy(mem->buf, upd->preload->buf, mem->size);
+    memcpy(mem->tags, upd->preload->tags, mem->size);
+    return upd->presize;
+  }
+
+  return fileio(oprwv, upd->filename, upd->format, p, upd->memtype, -1);
+}
+
+/*
+ * Basic checks to reveal serious failure before programming; input files of
+ * write and verify operations are read, too, unless they are stdin or files
+ * that an earlier read operation of this run writes
+ */
 int update_dryrun(const AVRPART *p, UPDATE *upd) {
   static char **wrote;
   static int nfwritten;
 
-  int known, format_detect, ret = LIBAVRDUDE_SUCCESS;
+  int known, written = 0, format_detect, ret = LIBAVRDUDE_SUCCESS;
 
   /*
    * Reject an update if memory name is not known amongst any part (suspect a typo)
    * but accept when the specific part does not have it (allow unifying i/faces)
    */
-  if(!avr_mem_might_be_known(upd->memtype)) {
+  if(!strcmp(upd->memtype, "all")) {
+    if(upd->op != DEVICE_READ) {
+      pmsg_error("-U all:... is only supported for reading the device\n");
+      ret = LIBAVRDUDE_GENERAL_FAILURE;
+    } else if(upd->format != FMT_SPARSE) {
+      pmsg_error("-U all:r:... needs the sparse binary image format x\n");
+      ret = LIBAVRDUDE_GENERAL_FAILURE;
+    }
+  } else if(!avr_mem_might_be_known(upd->memtype)) {
     pmsg_error("unknown memory type %s\n", upd->memtype);
     ret = LIBAVRDUDE_GENERAL_FAILURE;
   } else if(p && !avr_locate_mem(p, upd->memtype))
@@ -367,7 +413,7 @@ int update_dryrun(const AVRPART *p, UPDATE *upd) {
       // Need to read the file: was it written before, so will be known?
       for(int i = 0; i < nfwritten; i++)
         if(!wrote || (upd->filename && !strcmp(wrote[i], upd->filename)))
-          known = 1;
+          known = written = 1;
 
       errno = 0;
       if(!known && !update_is_readable(upd->filename)) {
@@ -422,16 +468,146 @@ int update_dryrun(const AVRPART *p, UPDATE *upd) {
     ret = LIBAVRDUDE_GENERAL_FAILURE;
   }
 
+  if(ret == LIBAVRDUDE_SUCCESS && p && !written && !upd->preload && strcmp(upd->filename, "-") &&
+    (upd->op == DEVICE_WRITE || upd->op == DEVICE_VERIFY))
+    ret = update_preload(p, upd);
+
   return ret;
 }
 
 
-int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags flags) {
+/*
+ * Differential write: read back the pages that are to be written and drop those from the
+ * write by clearing their allocation tags; the caller restores the tags after writing so
+ * that verification still covers these pages. Pages are read through the cache, so pages
+ * known from earlier operations or from a persistent cache file need not be read again.
+ * Comparison uses the effective erase page size for bootloaders, as these might erase
+ * several pages when writing the first one of a group. Flash that has been erased in this
+ * run (UF_ERASED) is compared to 0xff without reading it back. Returns the number of
+ * skipped pages or a negative value on failure.
+ */
+static int update_skip_unchanged(const PROGRAMMER *pgm, const AVRPART *p, AVRMEM *mem, int size,
+  enum updateflags flags) {
+  if(!avr_has_paged_access(pgm, mem) || mem->page_size < 2)
+    return 0;
+
+  int pgsize = mem->page_size, grsize = (pgm->prog_modes & PM_SPM) && p->n_page_erase > 0?
+    p->n_page_erase*pgsize: pgsize;
+  if((grsize & (grsize-1)) || mem->size % grsize)
+    grsize = pgsize;
+
+  int nskipped = 0, end = size < mem->size? size: mem->size;
+  unsigned char *spc = cfg_malloc(__func__, pgsize);
+  int erased = (flags & UF_ERASED) && avr_mem_is_flash_type(mem);
+
+  if(erased)
+    memset(spc, 0xff, pgsize);
+
+  for(int grp = 0; grp < end; grp += grsize) {
+    int nset = 0, same = 1;
+
+    for(int pg = grp; same && pg < grp+grsize; pg += pgsize) {
+      int pgset = 0;
+      for(int i = pg; i < pg+pgsize; i++)
+        if(mem->tags[i] & TAG_ALLOCATED)
+          pgset++;
+      if(!pgset)
+        continue;
+      nset += pgset;
+
+      if(!erased && avr_peek_page_cached(pgm, p, mem, pg, spc) < 0) {
+        free(spc);
+        return -1;
+      }
+      for(int i = pg; i < pg+pgsize; i++)
+        if((mem->tags[i] & TAG_ALLOCATED) && mem->buf[i] != spc[i-pg]) {
+          same = 0;
+          break;
+        }
+    }
+
+    if(nset && same) {
+      for(int pg = grp; pg < grp+grsize; pg += pgsize) {
+        int pgset = 0;
+        for(int i = pg; i < pg+pgsize; i++) {
+          pgset |= mem->tags[i] & TAG_ALLOCATED;
+          mem->tags[i] &= ~TAG_ALLOCATED;
+        }
+        if(pgset)
+          nskipped++;
+      }
+      pmsg_debug("%s(): %s [0x%04x, 0x%04x] unchanged\n", __func__, mem->desc, grp, grp+grsize-1);
+    }
+  }
+  free(spc);
+
+  return nskipped;
+}
+
+
+/*
+ * Dump all memories of the part into one file for -U all:r:file: a
+ * sequence of sparse binary images, each appended as soon as its memory
+ * has been read. Sub-regions of flash are left out. Memories that cannot
+ * be read are skipped after a warning. Single memories can be restored
+ * from the file with, eg, -U eeprom:w:file:x
+ */
+static int update_dump_all(const PROGRAMMER *pgm, const AVRPART *p, const UPDATE *upd) {
+  const char *fname = update_outname(upd->filename);
+  int ret = LIBAVRDUDE_SUCCESS, nmem = 0, nfail = 0;
+  FILE *f = strcmp(upd->filename, "-")? fopen(upd->filename, "wb"): stdout;
+
+  if(!f) {
+    pmsg_ext_error("cannot open output file %s: %s\n", fname, strerror(errno));
+    return LIBAVRDUDE_GENERAL_FAILURE;
+  }
+
+  for(LNODEID ln = lfirst(p->mem); ln; ln = lnext(ln)) {
+    AVRMEM *mem = ldata(ln);
+
+    if(mem->size <= 0 || ((p->prog_modes & PM_PDI) && (!strcmp(mem->desc, "boot") ||
+      !strcmp(mem->desc, "application") || !strcmp(mem->desc, "apptable"))))
+      continue;
+
+    pmsg_info("reading %s memory ...\n", mem->desc);
+    if(mem->size > 32 || verbose > 1)
+      report_progress(0, 1, "Reading");
+    int rc = avr_read_mem_cached(pgm, p, mem, 0);
+    report_progress(1, 1, NULL);
+    if(rc < 0) {
+      pmsg_warning("unable to read %s memory, rc=%d, not included in %s\n", mem->desc, rc, fname);
+      nfail++;
+      continue;
+    }
+    if(fileio_sparse_append(f, fname, p, mem, rc) < 0 || fflush(f)) {
+      pmsg_error("write to file %s failed\n", fname);
+      ret = LIBAVRDUDE_GENERAL_FAILURE;
+      break;
+    }
+    nmem++;
+  }
+
+  if(f != stdout)
+    fclose(f);
+
+  if(ret == LIBAVRDUDE_SUCCESS)
+    pmsg_info("wrote %d memor%s to %s%s\n", nmem, nmem == 1? "y": "ies", fname,
+      nfail? ", some could not be read": "");
+
+  return ret;
+}
+
+
+static int update_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags flags) {
   AVRPART *v;
   AVRMEM *mem;
   int size;
   int rc;
   Filestats fs, fs_patched;
+  unsigned char *savedtags = NULL;
+
+  if(!strcmp(upd->memtype, "all"))
+    return update_dump_all(pgm, p, upd);
 
   mem = avr_locate_mem(p, upd->memtype);
   if (mem == NULL) {
@@ -455,10 +631,11 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
     }
     pmsg_info("reading %s%s memory ...\n", mem->desc, alias_mem_desc);
 
+    trace_phase("read");
     if(mem->size > 32 || verbose > 1)
       report_progress(0, 1, "Reading");
     
-    rc = avr_read(pgm, p, upd->memtype, 0);
+    rc = avr_read_mem_cached(pgm, p, mem, 0);
     report_progress(1, 1, NULL);
     if (rc < 0) {
       pmsg_error("unable to read all of %s%s memory, rc=%d\n", mem->desc, alias_mem_desc, rc);
@@ -470,6 +647,7 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
       pmsg_notice("flash is empty, resulting file has no contents\n");
     pmsg_info("writing output file %s\n", update_outname(upd->filename));
 
+    trace_phase("file write");
     rc = fileio(FIO_WRITE, upd->filename, upd->format, p, upd->memtype, size);
     if (rc < 0) {
       pmsg_error("write to file %s failed\n", update_outname(upd->filename));
@@ -480,7 +658,8 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
   case DEVICE_WRITE:
     // Write the selected device memory using data from a file
 
-    rc = fileio(FIO_READ, upd->filename, upd->format, p, upd->memtype, -1);
+    trace_phase("file parse");
+    rc = update_readfile(p, upd, mem, FIO_READ);
     if (rc < 0) {
       pmsg_error("read from file %s failed\n", update_inname(upd->filename));
       return LIBAVRDUDE_GENERAL_FAILURE;
@@ -542,6 +721,25 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
     pmsg_info("writing %d byte%s %s%s ...\n", fs.nbytes,
       update_plural(fs.nbytes), mem->desc, alias_mem_desc);
 
+    trace_phase("write");
+
+    if (!(flags & UF_NOWRITE) && (flags & UF_SKIP_UNCHANGED)) {
+      if(mem->size > 32 || verbose > 1)
+        report_progress(0, 1, "Comparing");
+      savedtags = cfg_malloc(__func__, mem->size);
+      memcpy(savedtags, mem->tags, mem->size);
+      rc = update_skip_unchanged(pgm, p, mem, size, flags);
+      report_progress(1, 1, NULL);
+      if (rc < 0) {
+        pmsg_error("unable to read back %s%s memory for comparison\n", mem->desc, alias_mem_desc);
+        free(savedtags);
+        return LIBAVRDUDE_GENERAL_FAILURE;
+      }
+      if (rc > 0)
+        pmsg_info("skipping %d unchanged page%s of %s%s\n", rc, update_plural(rc), mem->desc,
+          alias_mem_desc);
+    }
+
     if (!(flags & UF_NOWRITE)) {
       if(mem->size > 32 || verbose > 1)
         report_progress(0, 1, "Writing");
@@ -552,6 +750,15 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
       rc = fileio(FIO_WRITE, "-", FMT_IHEX, p, upd->memtype, size);
     }
 
+    if (!(flags & UF_NOWRITE))  // Written pages need to be read back from the device
+      avr_cache_forget(pgm, p, mem);
+
+    if (savedtags) {            // Verify skipped pages, too
+      memcpy(mem->tags, savedtags, mem->size);
+      free(savedtags);
+      savedtags = NULL;
+    }
+
     if (rc < 0) {
       pmsg_error("unable to write %s%s memory, rc=%d\n", mem->desc, alias_mem_desc, rc);
       return LIBAVRDUDE_GENERAL_FAILURE;
@@ -577,7 +784,8 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
       pmsg_notice("load %s%s data from input file %s\n", mem->desc,
         alias_mem_desc, update_inname(upd->filename));
 
-      rc = fileio(FIO_READ_FOR_VERIFY, upd->filename, upd->format, p, upd->memtype, -1);
+      trace_phase("file parse");
+      rc = update_readfile(p, upd, mem, FIO_READ_FOR_VERIFY);
 
       if (rc < 0) {
         pmsg_error("read from file %s failed\n", update_inname(upd->filename));
@@ -592,6 +800,7 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
       size = fs.lastaddr+1;
     }
 
+    trace_phase("verify");
     v = avr_dup_part(p);
 
     if (quell_progress < 2) {
@@ -603,7 +812,7 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
 
     if(mem->size > 32 || verbose > 1)
       report_progress (0,1,"Reading");
-    rc = avr_read(pgm, p, upd->memtype, v);
+    rc = avr_read_mem_cached(pgm, p, mem, v);
     report_progress (1,1,NULL);
     if (rc < 0) {
       pmsg_error("unable to read all of %s%s memory, rc=%d\n", mem->desc, alias_mem_desc, rc);
@@ -637,3 +846,19 @@ int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags
 
   return LIBAVRDUDE_SUCCESS;
 }
+
+int do_op(const PROGRAMMER *pgm, const AVRPART *p, UPDATE *upd, enum updateflags flags) {
+  char name[64];
+  int rc;
+
+  if(!trace_active)
+    return update_op(pgm, p, upd, flags);
+
+  snprintf(name, sizeof name, "%s:%c", upd->memtype,
+    upd->op == DEVICE_READ? 'r': upd->op == DEVICE_WRITE? 'w': 'v');
+  trace_begin(name, 0xff);
+  rc = update_op(pgm, p, upd, flags);
+  trace_end(name, 0xff);
+
+  return rc;
+}
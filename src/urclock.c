@@ -258,6 +258,10 @@ typedef struct {
 
   int sync_silence;             // Temporarily set during start of synchronisation
 
+  // Windowed paged writes: page programming commands sent but not yet acknowledged
+  int npending;                 // Number of outstanding STK_INSYNC/STK_OK responses
+  int inwindow;                 // Set while sending a page that may leave its response pending
+
   // Info needed about bootloader to patch, if needed, the reset vector and one other vector
   int vblvectornum,             // Vector bootloader vector number for jump to application op code
       vbllevel,                 // 0=n/a, 1=patch externally, 2=bl patches, 3=bl patches & verifies
@@ -317,6 +321,7 @@ typedef struct {
       nodate,                   // Don't store application filename and no date either
       nometadata,               // Don't store any metadata at all (implies no store support)
       delay,                    // Additional delay [ms] after resetting the board, can be negative
+      window,                   // Max number of unacknowledged page writes (urprotocol only)
       strict;                   // Use strict synchronisation protocol
 
   char title[254];              // Use instead of filename for metadata - same size as filename
@@ -1909,7 +1914,25 @@ static int readUrclockID(const PROGRAMMER *pgm, const AVRPART *p, uint64_t *urcl
 }
 
 
+// Collect responses of page writes that were sent ahead in windowed mode
+static int urclock_drain_pending(const PROGRAMMER *pgm) {
+  int rc = 0;
+
+  while(ur.npending > 0) {
+    ur.npending--;
+    if(urclock_res_check(pgm, __func__, 0, NULL, 0) < 0)
+      rc = -1;
+  }
+
+  return rc;
+}
+
+
 static int urclock_send(const PROGRAMMER *pgm, unsigned char *buf, size_t len) {
+  // Any command other than a windowed page write needs the bootloader to have caught up
+  if(ur.npending && !ur.inwindow && urclock_drain_pending(pgm) < 0)
+    return -1;
+
   return serial_send(&pgm->fd, buf, len);
 }
 
@@ -2282,14 +2305,42 @@ static int urclock_paged_write(const PROGRAMMER *pgm, const AVRPART *p, const AV
 
     n = addr + n_bytes;
 
+    /*
+     * Windowed mode: send the next page while the bootloader still acknowledges previous ones.
+     * Only possible with urprotocol (no interspersed load-address handshake) and bootloaders
+     * that keep receiving whilst programming a page, which the user asserts with -xwindow=<n>.
+     */
+    int window = ur.urprotocol && ur.window > 1? ur.window: 1;
+
     for(; addr < n; addr += chunk) {
       chunk = n-addr < page_size? n-addr: page_size;
 
-      if(urclock_paged_rdwr(pgm, p, Cmnd_STK_PROG_PAGE, addr, chunk, mchr, (char *) m->buf+addr)<0)
+      ur.inwindow = window > 1;
+      int rc = urclock_paged_rdwr(pgm, p, Cmnd_STK_PROG_PAGE, addr, chunk, mchr, (char *) m->buf+addr);
+      ur.inwindow = 0;
+      if(rc < 0) {              // Responses still due are no longer meaningful
+        ur.npending = 0;
+        serial_drain(&pgm->fd, 0);
         return -3;
-      if(urclock_res_check(pgm, __func__, 0, NULL, 0) < 0)
+      }
+      if(window > 1) {          // Keep at most window-1 responses outstanding
+        if(++ur.npending >= window) {
+          ur.npending--;
+          if(urclock_res_check(pgm, __func__, 0, NULL, 0) < 0) {
+            ur.npending = 0;
+            serial_drain(&pgm->fd, 0);
+            return -4;
+          }
+        }
+      } else if(urclock_res_check(pgm, __func__, 0, NULL, 0) < 0)
         return -4;
     }
+
+    // All pages of this call must have been acknowledged before reporting success
+    if(urclock_drain_pending(pgm) < 0) {
+      serial_drain(&pgm->fd, 0);
+      return -4;
+    }
   }
 
   return n_bytes;
@@ -2466,6 +2517,7 @@ static int urclock_parseextparms(const PROGRAMMER *pgm, LISTID extparms) {
     {"nometadata", &ur.nometadata, NA,    "Do not store metadata at all (ie, no store support)"},
     {"delay", &ur.delay, ARG,             "Add delay [ms] after reset, can be negative"},
     {"strict", &ur.strict, NA,            "Use strict synchronisation protocol"},
+    {"window", &ur.window, ARG,           "Keep up to <arg> page writes in flight (buffering b/l)"},
     {"help", &help, NA,                   "Show this help menu and exit"},
   };
 
@@ -0,0 +1,193 @@
+/*
+ * trace-decode - render avrdude -R programmer I/O traces
+ *
+ * published under GNU General Public License, version 2 or later
+ *
+ * Built as trace-decode in the build directory of src by both CMake and
+ * automake, but not installed; standalone:  cc -O2 -o trace-decode trace-decode.c
+ * Usage:  trace-decode [-j] tracefile
+ *
+ * Without options the trace is printed as text, one line per record with
+ * the time since the start of the trace, the nesting of commands and
+ * memory operations and the bytes sent (>>) and received (<<) in hex and
+ * ASCII; the end of each command shows its duration. With -j the trace is
+ * written as Chrome trace JSON for chrome://tracing or ui.perfetto.dev,
+ * where commands and memory operations show as duration events and
+ * transfers as instant events carrying their bytes. See src/trace.c for
+ * the file format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+enum { TRACE_TX = 1, TRACE_RX, TRACE_BEGIN, TRACE_END };
+
+#define MAXDEPTH 64
+
+static const char *progname;
+
+static unsigned long get32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | (unsigned long) p[2] << 16 | (unsigned long) p[3] << 24;
+}
+
+// Names of STK500v2 commands, which stk500v2_command() records as code
+static const char *stk500v2_cmd(int code) {
+  static const struct { int code; const char *name; } cmds[] = {
+    {0x01, "SIGN_ON"}, {0x02, "SET_PARAMETER"}, {0x03, "GET_PARAMETER"},
+    {0x04, "SET_DEVICE_PARAMETERS"}, {0x05, "OSCCAL"}, {0x06, "LOAD_ADDRESS"},
+    {0x07, "FIRMWARE_UPGRADE"}, {0x0d, "CHECK_TARGET_CONNECTION"},
+    {0x10, "ENTER_PROGMODE_ISP"}, {0x11, "LEAVE_PROGMODE_ISP"}, {0x12, "CHIP_ERASE_ISP"},
+    {0x13, "PROGRAM_FLASH_ISP"}, {0x14, "READ_FLASH_ISP"}, {0x15, "PROGRAM_EEPROM_ISP"},
+    {0x16, "READ_EEPROM_ISP"}, {0x17, "PROGRAM_FUSE_ISP"}, {0x18, "READ_FUSE_ISP"},
+    {0x19, "PROGRAM_LOCK_ISP"}, {0x1a, "READ_LOCK_ISP"}, {0x1b, "READ_SIGNATURE_ISP"},
+    {0x1c, "READ_OSCCAL_ISP"}, {0x1d, "SPI_MULTI"},
+    {0x20, "ENTER_PROGMODE_PP"}, {0x21, "LEAVE_PROGMODE_PP"}, {0x22, "CHIP_ERASE_PP"},
+    {0x23, "PROGRAM_FLASH_PP"}, {0x24, "READ_FLASH_PP"}, {0x25, "PROGRAM_EEPROM_PP"},
+    {0x26, "READ_EEPROM_PP"}, {0x27, "PROGRAM_FUSE_PP"}, {0x28, "READ_FUSE_PP"},
+    {0x29, "PROGRAM_LOCK_PP"}, {0x2a, "READ_LOCK_PP"}, {0x2b, "READ_SIGNATURE_PP"},
+    {0x2c, "READ_OSCCAL_PP"}, {0x2d, "SET_CONTROL_STACK"},
+    {0x30, "ENTER_PROGMODE_HVSP"}, {0x31, "LEAVE_PROGMODE_HVSP"}, {0x32, "CHIP_ERASE_HVSP"},
+    {0x33, "PROGRAM_FLASH_HVSP"}, {0x34, "READ_FLASH_HVSP"}, {0x35, "PROGRAM_EEPROM_HVSP"},
+    {0x36, "READ_EEPROM_HVSP"}, {0x37, "PROGRAM_FUSE_HVSP"}, {0x38, "READ_FUSE_HVSP"},
+    {0x39, "PROGRAM_LOCK_HVSP"}, {0x3a, "READ_LOCK_HVSP"}, {0x3b, "READ_SIGNATURE_HVSP"},
+    {0x3c, "READ_OSCCAL_HVSP"}, {0x50, "XPROG"}, {0x51, "XPROG_SETMODE"},
+  };
+
+  for(size_t i = 0; i < sizeof cmds/sizeof *cmds; i++)
+    if(cmds[i].code == code)
+      return cmds[i].name;
+  return NULL;
+}
+
+// Print name of a command or memory operation, decorated with its code
+static void pr_name(FILE *out, const unsigned char *d, int len, int code, int json) {
+  const char *cmd = NULL;
+
+  if(len == 16 && !memcmp(d, "stk500v2_command", 16))
+    cmd = stk500v2_cmd(code);
+
+  for(int i = 0; i < len; i++)
+    fputc(json && (d[i] == '"' || d[i] == '\\')? '\'': d[i], out);
+  if(cmd)
+    fprintf(out, " %s", cmd);
+  else if(code != 0xff)
+    fprintf(out, " 0x%02x", code);
+}
+
+static void pr_bytes(FILE *out, const unsigned char *d, int len) {
+  for(int i = 0; i < len; i++)
+    fprintf(out, "%s%02x", i? " ": "", d[i]);
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: %s [-j] tracefile\n", progname);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  unsigned char hdr[24], rec[8], *data;
+  unsigned long nrec, dropped, t, last = 0, wraps = 0;
+  unsigned long long begin[MAXDEPTH], now;
+  int json = 0, depth = 0, first = 1;
+  FILE *in;
+
+  progname = argv[0];
+  if(argc > 1 && !strcmp(argv[1], "-j"))
+    json = 1, argc--, argv++;
+  if(argc != 2)
+    usage();
+
+  if(!(in = fopen(argv[1], "rb"))) {
+    perror(argv[1]);
+    return 1;
+  }
+  if(fread(hdr, 1, sizeof hdr, in) != sizeof hdr || memcmp(hdr, "AVRTRC1\n", 8)) {
+    fprintf(stderr, "%s: %s is not an avrdude trace file\n", progname, argv[1]);
+    return 1;
+  }
+  nrec = get32(hdr+16);
+  dropped = get32(hdr+20);
+  data = malloc(0x10000);
+
+  if(json)
+    printf("{\"traceEvents\":[\n");
+  else
+    printf("# %lu records, %lu dropped before these\n", nrec, dropped);
+
+  for(unsigned long i = 0; i < nrec; i++) {
+    int type, code, len, matched = 0;
+
+    if(fread(rec, 1, sizeof rec, in) != sizeof rec)
+      break;
+    type = rec[4];
+    code = rec[5];
+    len = rec[6] | rec[7] << 8;
+    if(fread(data, 1, len, in) != (size_t) len)
+      break;
+
+    t = get32(rec);             // Timestamps roll over after ca 71 min
+    if(t < last)
+      wraps++;
+    last = t;
+    now = ((unsigned long long) wraps << 32) + t;
+
+    if(json) {
+      printf("%s{\"pid\":1,\"tid\":1,\"ts\":%llu,", first? "": ",\n", now);
+      first = 0;
+      switch(type) {
+      case TRACE_BEGIN:
+      case TRACE_END:
+        printf("\"ph\":\"%s\",\"name\":\"", type == TRACE_BEGIN? "B": "E");
+        pr_name(stdout, data, len, code, 1);
+        printf("\"}");
+        break;
+      default:
+        printf("\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s%s %d\",\"args\":{\"data\":\"",
+          type == TRACE_TX? "tx": "rx", code? " error": "", len);
+        pr_bytes(stdout, data, len);
+        printf("\"}}");
+      }
+      continue;
+    }
+
+    if(type == TRACE_END && depth > 0)
+      depth--, matched = 1;
+    printf("%10.6f %*s", now/1e6, 2*depth, "");
+    switch(type) {
+    case TRACE_BEGIN:
+      pr_name(stdout, data, len, code, 0);
+      printf(" {\n");
+      if(depth < MAXDEPTH)
+        begin[depth] = now;
+      depth++;
+      break;
+    case TRACE_END:
+      printf("} ");
+      pr_name(stdout, data, len, code, 0);
+      if(matched && depth < MAXDEPTH)
+        printf(" %.3f ms", (now - begin[depth])/1e3);
+      printf("\n");
+      break;
+    default:
+      printf("%s", type == TRACE_TX? ">>": "<<");
+      if(code)
+        printf(" error");
+      for(int k = 0; k < len; k++)
+        printf(" %02x", data[k]);
+      printf("  |");
+      for(int k = 0; k < len; k++)
+        putchar(isprint(data[k])? data[k]: '.');
+      printf("|\n");
+    }
+  }
+
+  if(json)
+    printf("\n]}\n");
+
+  free(data);
+  fclose(in);
+
+  return 0;
+}